@@ -0,0 +1,65 @@
+#ifndef ADMIT_H
+#define ADMIT_H
+
+#include "history.h"
+
+/*
+Memory-aware admission (--mem-budget <size>).
+
+Without a budget a batch is simply the next batch_size pending pairs, however
+much memory they need, so a few memory-hungry submissions landing in the same
+batch can make the host swap. With a budget every pair has an estimated peak
+RSS:
+
+    its own peak (ru_maxrss) in the previous run, from the --history file
+    else the largest peak of the same executable so far in this run
+    else --mem-estimate <size> (default: --mem-limit if set, else ADMIT_DEFAULT_KB)
+
+and a batch only admits pairs while the sum of their estimates fits into the
+budget. The next pending pair is always admitted, even if it doesn't fit on its
+own, so grading can't stall. The following ADMIT_LOOKAHEAD pending pairs are
+then scanned in order and every one that still fits is admitted too (first
+fit), up to batch_size: small pairs get packed around a large one instead of
+waiting behind it. Pairs passed over keep their order and go first in the next
+batch.
+*/
+
+// Estimated peak RSS of pairs nothing is known about, in KB
+#define ADMIT_DEFAULT_KB (64 * 1024)
+
+// Pending pairs scanned for one that fits into what's left of the budget
+#define ADMIT_LOOKAHEAD 256
+
+extern long long admit_budget_kb;     // --mem-budget, 0 if off
+
+#define ADMIT_ON (admit_budget_kb > 0)
+
+// Batches that left out a pair to stay within the budget, and pairs admitted although
+// they alone exceed it
+extern long admit_limited;
+extern long admit_oversized;
+
+
+// Take --mem-budget <size> and --mem-estimate <size> out of argv (see take_option()).
+// Must be called after contain_limits_from_args(), exits if malformed.
+void admit_from_args(int *argc, char **argv);
+
+
+// Estimated peak RSS in KB of the executable at exe_path on the parameter label
+// (history may be NULL, see above)
+long long admit_estimate(history_t *history, const char *exe_path, const char *label);
+
+
+// Remember that the executable at exe_path just peaked at rss_kb (its child's ru_maxrss)
+void admit_observe(const char *exe_path, long rss_kb);
+
+
+// Move the pairs of the next batch out of pending pairs order[0..n-1] to its front,
+// estimate(order[k], arg) being the estimated peak RSS of pair k in KB. Returns how
+// many were admitted (at least 1, at most batch_size).
+int admit_batch(int *order, int n, int batch_size, long long (*estimate)(int, void *), void *arg);
+
+
+void admit_free();
+
+#endif // ADMIT_H
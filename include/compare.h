@@ -0,0 +1,116 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <sys/types.h>
+#include "feed.h"
+
+/*
+Streaming expected-output comparison (--expected <dir> [--compare <mode>]).
+
+Without --expected, a child's status is the integer it prints (see template.c).
+With it, the child's stdout goes to a pipe instead of output/<exe>.<param> and
+is compared, as it streams in, against the golden file <dir>/<label>.out of
+its parameter: CORRECT if it matches, INCORRECT otherwise. Modes:
+
+    exact           byte-for-byte
+    ws              whitespace-insensitive (runs of whitespace are one space,
+                    leading/trailing whitespace is ignored)
+    numeric[:tol]   whitespace-separated tokens; numbers match within
+                    tol * max(1, |expected|) (default 1e-6), other tokens exactly
+
+Each golden file is read once per parameter and reduced to a digest that every
+submission is checked against: FNV-1a hashes of fixed-size chunks of the
+normalized stream (exact/ws), or the parsed token list (numeric). The first
+mismatching chunk/token decides the verdict, at which point the pipe is closed
+and the child is killed, so no time is spent on programs that already failed.
+*/
+
+// Normalized bytes per chunk hash
+#define COMPARE_CHUNK 4096
+
+// How often compare_drain() checks for children that exited while processes they
+// left behind still hold their stdout open
+#define COMPARE_EXIT_POLL_MS 50
+
+enum {
+    COMPARE_EXACT = 1,
+    COMPARE_WS,
+    COMPARE_NUMERIC
+};
+
+// One golden token in numeric mode
+typedef struct {
+    unsigned long long hash;    // Hash of the token text
+    double value;               // Parsed value if is_num
+    int is_num;
+} golden_token_t;
+
+// Precomputed digest of one golden file
+typedef struct {
+    int mode;
+    double tol;
+
+    unsigned long long *chunk_hashes;   // exact/ws: hash of each COMPARE_CHUNK normalized bytes
+    long num_chunks;
+    long long length;                   // exact/ws: normalized length
+
+    golden_token_t *tokens;             // numeric: every token of the file
+    long num_tokens;
+} golden_t;
+
+// Comparison state of one child's output stream
+typedef struct {
+    golden_t *golden;
+    int mismatch;               // 1 once the output can no longer match
+    int finished;               // 1 once compare_finish() has seen the whole stream
+    int killed;                 // 1 if compare_drain() killed the child on a mismatch
+    int over_limit;             // 1 if it was killed for writing more than contain_limits.output
+    long long bytes;            // Raw bytes of output seen
+
+    long long length;           // exact/ws: normalized bytes seen
+    unsigned long long hash;    // exact/ws: hash of the current (partial) chunk
+    int pending_space;          // ws: whitespace seen after some output
+
+    long token_idx;             // numeric: tokens seen
+    unsigned long long token_hash;  // numeric: hash of the current (partial) token
+    char token_text[64];        // numeric: start of the current token, for strtod
+    int token_len;
+} compare_t;
+
+
+// Parse the --compare mode ("exact", "ws", "numeric" or "numeric:<tol>"), exit if malformed
+void compare_parse_mode(const char *spec, int *mode, double *tol);
+
+
+// Read <dir>/<label>.out and compute its digest, exit if it doesn't exist
+golden_t *golden_load(const char *dir, const char *label, int mode, double tol);
+
+
+// Free a digest returned by golden_load()
+void golden_free(golden_t *golden);
+
+
+// Start comparing a new output stream against golden
+void compare_init(compare_t *cmp, golden_t *golden);
+
+
+// Feed the next n bytes of output. Returns 0 while the output may still match,
+// -1 once it can't (then cmp->mismatch is set and further input is ignored).
+int compare_feed(compare_t *cmp, const char *buf, ssize_t n);
+
+
+// End of output: returns CORRECT if the whole stream matched, INCORRECT otherwise
+int compare_finish(compare_t *cmp);
+
+
+// Drain the stdout pipes fds[0..n-1] of the children pids[0..n-1] (fds[j] == -1 is
+// skipped), comparing each stream with cmps[j] as it arrives, while delivering their
+// input through feeds[0..n-1] (PIPE mode, see feed.h). fds or feeds may be NULL if
+// there are no such pipes. A child whose output mismatches (or exceeds the output
+// limit, see contain.h) has its pipes closed and its whole tree killed (pids[j] runs
+// in slot j). Returns when every pipe has been closed (their fds are set to -1), or
+// as soon as *timed_out is non-zero (the remaining pipes are then closed too).
+void compare_drain(int n, int *fds, compare_t *cmps, feed_t *feeds, pid_t *pids,
+                   volatile long long *timed_out);
+
+#endif // COMPARE_H
@@ -0,0 +1,94 @@
+#ifndef CONTAIN_H
+#define CONTAIN_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/*
+Process tree containment for children under test.
+
+Every child is made the leader of its own process group, so a timeout (or a
+failed output comparison) kills the whole tree it spawned with killpg() rather
+than just the direct child. When a cgroup v2 hierarchy is mounted and writable,
+each concurrency slot also gets a cgroup under
+
+    <cgroup2 mount><own cgroup>/autograder.<pid>/slot<N>
+
+that the child joins before exec(), so descendants that escape the process
+group (setsid(), daemonizing) are still killed through cgroup.kill.
+
+The grader is also made a child subreaper, so orphaned descendants are
+re-parented to it instead of init. After each child is reaped its group and
+cgroup are checked for leftover processes, and whatever is still around at the
+end of the run is killed; all of these leaks are reported by contain_finish().
+
+Optional per-child limits (--mem-limit, --output-limit, --proc-limit) are set
+up here as well: memory.max and pids.max of the slot cgroups when those
+controllers can be enabled, and RLIMIT_AS/RLIMIT_NPROC otherwise. Output is
+capped with RLIMIT_FSIZE (output files) or counted by compare_drain() (pipes).
+*/
+
+// Per-child resource limits, 0 if unlimited
+typedef struct {
+    long long memory;       // Bytes of memory (address space without the memory controller)
+    long long output;       // Bytes of output
+    int procs;              // Processes in the child's tree
+} contain_limits_t;
+
+extern contain_limits_t contain_limits;
+
+
+// Take --mem-limit <size>, --output-limit <size> and --proc-limit <n> out of argv
+// (see take_option()) into contain_limits. Sizes are bytes with an optional K, M or
+// G suffix. Must be called before contain_init(), exits if malformed.
+void contain_limits_from_args(int *argc, char **argv);
+
+
+// Set up containment for num_slots concurrent children (cgroups are optional)
+void contain_init(int num_slots);
+
+
+// In the child after fork(): become a process group leader and join slot's cgroup
+void contain_enter(int slot);
+
+
+// In the parent after fork(): put the child in its own process group too, so there
+// is no window where a timeout could miss it
+void contain_adopt(pid_t pid);
+
+
+// After the child of slot has been reaped with the given wait status and resource
+// usage: the limit it ran into (OUT_OF_MEMORY, OUTPUT_LIMIT_EXCEEDED or
+// PROCESS_LIMIT_EXCEEDED), or 0. Must be called once for every reaped child.
+int contain_limit_status(int slot, int status, struct rusage *usage);
+
+
+// Kill the whole tree of the child pid running in slot (async-signal-safe). Does
+// nothing if pid has already exited, see contain_release().
+void contain_kill(pid_t pid, int slot);
+
+
+// After the child pid of slot has been reaped: kill anything it left behind in its
+// process group or cgroup and record it as leaked (exe and param name the culprit).
+// If the tree was already killed (killed = 1, e.g. on timeout) the leftovers are just
+// dying and aren't counted. Returns the number of leaked processes found.
+int contain_release(pid_t pid, int slot, int killed, const char *exe, const char *param);
+
+
+// In a process that runs graders (mq_autograder's workers): become a child subreaper,
+// so whatever a grader that dies leaves running comes back to us (see contain_bury())
+void contain_supervise();
+
+
+// After the grader pid (which called contain_init()) died without contain_finish():
+// kill everything it left running and remove its cgroups. Its children were
+// re-parented to us and lead their own process groups, unlike our own children.
+void contain_bury(pid_t pid);
+
+
+// End of run: kill orphans still attached to the grader, report every leak found
+// during the run to stderr and remove the cgroups. Every legitimate child of the
+// grader (workers, metrics server) must have been reaped by then.
+void contain_finish();
+
+#endif // CONTAIN_H
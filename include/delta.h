@@ -0,0 +1,80 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdio.h>
+
+/*
+Incremental result deltas (--delta <file>, applied with ./delta_apply).
+
+Before results.txt and scores.txt are replaced, their previous contents are
+read back as a table of (executable, parameter) cells and scores. Once the new
+files are written, the changes are appended to the delta file as a block of JSON
+lines:
+
+    {"columns":["1","2","#3"]}                    parameter labels, only if they changed
+    {"exe":"sol_4","cells":{"2":"crash"},"score":"0.500"}   changed cells/score of a row
+    {"exe":"sol_9","removed":true}                a row that is gone
+    {"end":true}
+
+A new executable gets a row with all its known cells. So what a gradebook sync
+has to read scales with how much changed, not with the size of the class. The
+file is truncated at the start of a run, and --watch appends one block per
+round. ./delta_apply <delta> [<results.txt> [<scores.txt>]] patches the old files
+into the new ones (byte for byte, as long as no two names have the same number
+after their last '_'). It applies every complete block and stops at a truncated
+one.
+*/
+
+// One executable's row of results.txt and its line of scores.txt
+typedef struct {
+    char *name;
+    char **cells;           // Status message of each column (see get_status_message())
+    char *score;            // As formatted in scores.txt, NULL if it has no line for the row
+} delta_row_t;
+
+typedef struct {
+    char **columns;         // Parameter labels
+    int num_columns;
+    delta_row_t *rows;
+    int num_rows;
+} delta_table_t;
+
+// Previous contents of a results and scores file, see delta_begin()
+typedef struct {
+    delta_table_t base;
+    const char *results_path;
+    const char *scores_path;
+} delta_t;
+
+
+// Read results_path and scores_path into table (missing files are an empty table),
+// returns -1 if results_path is malformed
+int delta_table_read(delta_table_t *table, const char *results_path, const char *scores_path);
+
+
+// Write table to results_path and scores_path in the format of write_results_to_file()
+// and write_scores_to_file() (rows without a score get theirs computed)
+void delta_table_write(delta_table_t *table, const char *results_path, const char *scores_path);
+
+
+void delta_table_free(delta_table_t *table);
+
+
+// Create (truncate) the delta file at path, exits if that fails
+FILE *delta_open(const char *path);
+
+
+// Remember what results_path and scores_path hold now, before they are replaced
+delta_t *delta_begin(const char *results_path, const char *scores_path);
+
+
+// Append the changes from delta's baseline to what the files hold now to out as one
+// block (see above) and free delta. Returns the number of rows that changed.
+int delta_end(delta_t *delta, FILE *out);
+
+
+// Apply the blocks of the delta file in to table, returns the number of complete
+// blocks applied or -1 if in is malformed
+int delta_patch(delta_table_t *table, FILE *in);
+
+#endif // DELTA_H
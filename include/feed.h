@@ -0,0 +1,54 @@
+#ifndef FEED_H
+#define FEED_H
+
+/*
+Nonblocking input delivery for PIPE mode.
+
+Each child reads its input from a pipe whose write end the grader keeps in
+nonblocking mode. The input is moved into the pipe without copying it through
+user space: splice() from a file (--input-dir <dir>, file <dir>/<label>.in)
+or vmsplice() from an in-memory buffer (the parameter itself). The pipes are
+enlarged to FEED_PIPE_SIZE where allowed to cut down on wake-ups.
+
+feed_step() pushes as much as fits and returns, so compare_drain() can drive
+every child's input alongside its output from one poll() loop, and a slow
+reader never blocks the grader. A child that exits (or closes its input)
+before reading everything just ends its feed on EPIPE; the grader ignores
+SIGPIPE for that, and children get the default disposition back before exec.
+
+vmsplice() hands the buffer's pages to the pipe by reference, so the buffer
+must stay unchanged until every child reading it has been reaped.
+*/
+
+// Requested capacity of each input pipe (F_SETPIPE_SZ, best effort)
+#define FEED_PIPE_SIZE (1 << 20)
+
+// Input delivery state of one child
+typedef struct {
+    int fd;                 // Write end of the child's input pipe, -1 once the feed is done
+    int src_fd;             // File to splice() the input from, -1 to vmsplice() buf
+    const char *buf;        // Input when src_fd is -1
+    long long len;          // Bytes of input
+    long long off;          // Bytes delivered so far
+    int copy;               // splice()/vmsplice() unsupported -> pread()/write() instead
+} feed_t;
+
+
+// Create a child's input pipe: the read end (for the child) in fds[0] and the
+// nonblocking, close-on-exec write end in fds[1]. Exits on failure.
+void feed_pipe(int fds[2]);
+
+
+// Start delivering len bytes into fd: from offset 0 of src_fd, or from buf if src_fd is -1
+void feed_start(feed_t *feed, int fd, int src_fd, const char *buf, long long len);
+
+
+// Push as much input as the pipe takes without blocking. Returns 1 while there is
+// more to deliver (poll fd for POLLOUT), 0 once the feed is done and fd closed.
+int feed_step(feed_t *feed);
+
+
+// Give up on the rest of the input and close the pipe (no-op if already done)
+void feed_stop(feed_t *feed);
+
+#endif // FEED_H
@@ -0,0 +1,59 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+
+/*
+Hashing (FNV-1a for strings, splitmix64 for numbers) and the open-addressing
+hash table behind the history, the staged executables and the memory estimates.
+
+The table keeps fixed-size slots whose first field is a char * key (a second
+char * field too for two-part keys, e.g. the history's (executable,
+parameter)). A NULL key marks an empty slot. Keys are copied on insert and
+freed with the table. The capacity is a power of two, doubled whenever the
+table would get more than half full, and collisions probe linearly.
+*/
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+typedef struct {
+    char *slots;                // capacity slots of slot_size bytes
+    size_t slot_size;
+    int num_keys;               // 1 or 2 leading char * key fields
+    long capacity;              // Power of two, 0 before hash_table_init()
+    long count;
+} hash_table_t;
+
+
+// FNV-1a of s, continuing from hash (FNV_OFFSET to start a new one)
+unsigned long long hash_string(unsigned long long hash, const char *s);
+
+
+// splitmix64's finalizer: a stateless, well-spread hash of x, e.g. for drawing the
+// k-th pseudo-random number of a seed as mix64(seed ^ mix64(k))
+unsigned long long mix64(unsigned long long x);
+
+
+// Empty table of slot_size byte slots with num_keys key fields, capacity a power of two
+void hash_table_init(hash_table_t *table, size_t slot_size, int num_keys, long capacity);
+
+
+// Slot with the key (key, key2), NULL if there is none. key2 is ignored by tables
+// with one key field.
+void *hash_table_find(hash_table_t *table, const char *key, const char *key2);
+
+
+// Slot with the key (key, key2), added (zeroed but for copies of the key) if there is
+// none. Slots may move, so earlier slot pointers are stale afterwards.
+void *hash_table_insert(hash_table_t *table, const char *key, const char *key2);
+
+
+// Slot i (0 <= i < capacity), NULL if it's empty
+void *hash_table_slot(hash_table_t *table, long i);
+
+
+// Free the keys and the slots (anything else the slots point to is the caller's)
+void hash_table_free(hash_table_t *table);
+
+#endif // HASH_H
@@ -0,0 +1,91 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "hash.h"
+
+/*
+Run history and longest-expected-job-first scheduling (--history <file>).
+
+The history file has one line per (executable, parameter) pair of previous
+runs:
+
+    <executable name> <parameter label> <status> <run time in us> [<peak RSS in KB>]
+
+It is loaded at the start of a run, updated with every pair that is tested and
+written back at the end. Each pair's run time is predicted from it: its own
+last run time, the timeout (stuck_us) for pairs that were stuck last time, else
+the average of the executable's other pairs, else the average of everything
+(pairs that were stuck count as the timeout in both). The pending pairs are
+then handed out longest first, so the slow ones don't end up in the last batch
+and stretch the run. Pairs with equal predictions (e.g. all of them, without
+any history) keep their original order.
+
+Batches run in lockstep (a batch ends when its slowest child does), so the
+predicted makespan of a list of pairs is the sum of the longest prediction of
+each batch.
+
+The peak RSS (the child's ru_maxrss) is optional so older files still load;
+it is only written for pairs whose peak is known (see admit.h).
+*/
+
+// Predicted run time of pairs that timed out last time, unless the timeout is set to
+// something else (history_t's stuck_us, e.g. a job's --timeout, see jobs.h)
+#define HISTORY_STUCK_US (TIMEOUT_SECS * 1000000LL)
+
+// One remembered (executable, parameter) pair
+typedef struct {
+    char *exe;                  // Executable name (not path), the key together with label
+    char *label;                // Parameter label (see params.h)
+    int status;                 // Outcome of the last run
+    long long duration_us;      // Run time of the last run
+    long rss_kb;                // Peak RSS of the last run that measured it, 0 if unknown
+} history_entry_t;
+
+typedef struct {
+    hash_table_t entries;       // history_entry_t on (exe, label)
+    int loaded;                 // Number of entries read from the file
+    long long stuck_us;         // Timeout of the pairs being predicted, HISTORY_STUCK_US by default
+
+    // Averages of the loaded entries, per executable and overall (see history.c)
+    hash_table_t averages;      // exe_average_t on exe
+    long long total_sum_us;
+    long total_stuck;
+    long total_count;
+} history_t;
+
+
+// Read the history file (a missing file is an empty history), exit if malformed
+history_t *history_load(const char *path);
+
+
+// Predicted run time of exe (name) on the parameter label in us, 0 without any history
+long long history_predict(history_t *history, const char *exe, const char *label);
+
+
+// Entry of (exe, label), NULL if the history doesn't have it
+history_entry_t *history_lookup(history_t *history, const char *exe, const char *label);
+
+
+// Remember the outcome, run time and peak RSS (0 if not measured: keeps the previous
+// one) of a pair tested in this run
+void history_record(history_t *history, const char *exe, const char *label, int status, long long duration_us,
+                    long rss_kb);
+
+
+// Write the history back to path (replaced atomically)
+void history_save(history_t *history, const char *path);
+
+
+void history_free(history_t *history);
+
+
+// Sort order[0..n-1] (indices into predicted) longest prediction first, keeping the
+// original order of equal predictions
+void history_sort(int *order, const long long *predicted, int n);
+
+
+// Predicted makespan of running pairs with predictions predicted[order[0..n-1]] in
+// that order, in lockstep batches of batch_size
+long long history_makespan(const int *order, const long long *predicted, int n, int batch_size);
+
+#endif // HISTORY_H
@@ -0,0 +1,73 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "params.h"
+
+/*
+Several grading jobs in one run (--jobs <file>).
+
+Every non-empty line of the job file that doesn't start with '#' is a job:
+
+    <name> <solutions dir> [options] <p1> <p2> ... | --params-file <file> | ...
+
+with the parameters given as on the command line (see params.h) and options
+
+    --weight <w>        share of the pool within its priority (default 1)
+    --priority <p>      jobs of a higher priority run first (default 0)
+    --timeout <secs>    timeout of its programs (default TIMEOUT_SECS)
+    --results <file>    default <name>.results.txt
+    --scores <file>     default <name>.scores.txt
+    --delta <file>      changes from the job's previous results (see delta.h)
+
+All jobs share the grader's concurrency pool one batch at a time. The next
+batch always goes to a job of the highest priority that has work left, and
+among those to the one that has used the least slot time (batch wall time
+times the programs in it) divided by its weight, so jobs of equal priority
+share the pool in proportion to their weights and a small job finishes early
+instead of queuing behind a large one. A job's results and scores are written
+as soon as it is done.
+
+The pool is shared by time, not by slot: a batch only holds children of one
+job, on one of its parameters. A batch runs in lockstep under a single alarm
+(the job's --timeout) with one golden output and one input file, so children
+of a job with a long timeout would hold up those of a job with a short one, and
+every parameter would need its own setup per slot. The cost is the last batch
+of each job on each parameter, which can leave up to batch_size - 1 slots idle
+for as long as it runs. A job is only charged for the slots its own children
+took, so idle slots count against no job's share.
+*/
+
+typedef struct {
+    char *name;
+    char *testdir;
+    param_source_t *params;
+    double weight;
+    int priority;
+    int timeout_secs;
+    char *results_path;
+    char *scores_path;
+    char *delta_path;           // NULL without --delta
+
+    double used;            // Slot time used so far (microseconds) / weight
+    int done;               // 1 once every parameter has been tested
+
+    char *line;             // The job's line of the job file, which argv points into
+    char **argv;
+} job_t;
+
+
+// Read the jobs of the job file at path, exits with a message if it is malformed
+job_t *jobs_load(const char *path, int *num_jobs);
+
+
+// Index of the job that gets the next batch, -1 once all are done
+int jobs_next(job_t *jobs, int num_jobs);
+
+
+// Charge a job for a batch that took slot_us of slot time
+void jobs_charge(job_t *job, long long slot_us);
+
+
+void jobs_free(job_t *jobs, int num_jobs);
+
+#endif // JOBS_H
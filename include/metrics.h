@@ -0,0 +1,72 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+Live counters served in Prometheus text format over a Unix socket (--metrics <socket>).
+
+The counters live in a System V shared memory segment so that the worker
+processes of mq_autograder can attach to the same segment (--metrics-shm <shmid>)
+and update them too. Updates are relaxed atomic adds on shared memory - no
+syscalls or locks on the harvest path. A forked server process answers each
+connection on the socket with an HTTP response containing the current values,
+so it can be scraped with e.g.
+
+    curl --unix-socket grader.sock http://localhost/metrics
+
+When metrics are off, metrics is NULL and every hook is a single branch.
+*/
+
+// Largest status code that gets its own outcome counter
+#define METRICS_MAX_STATUS 15
+
+// Upper bounds (microseconds) of the spawn latency histogram buckets (+Inf is implicit)
+#define METRICS_SPAWN_BUCKETS 10
+extern const long long metrics_spawn_bounds_us[METRICS_SPAWN_BUCKETS];
+
+typedef struct {
+    long pairs_total;                           // (executable, parameter) pairs in the run
+    long pairs_done;                            // Pairs graded so far
+    long outcomes[METRICS_MAX_STATUS + 1];      // Pairs graded per status code
+    long in_flight;                             // Children currently running
+    long timeout_kills;                         // Children killed by the timeout handler
+    long timeout_rechecks;                      // ... that were starved and ran again (see verify.h)
+    long timeout_overturned;                    // ... and didn't time out the second time
+    long spawn_buckets[METRICS_SPAWN_BUCKETS + 1];  // Spawn latency histogram (last is +Inf)
+    long spawn_sum_us;                          // Sum of all spawn latencies
+    int msqid;                                  // Message queue to report depth of (-1 if none)
+} metrics_t;
+
+// Shared counters, NULL when metrics are disabled
+extern metrics_t *metrics;
+
+#define METRICS_ON (metrics != NULL)
+
+// Lock-free counter update, safe from any process attached to the segment
+#define METRICS_ADD(field, n) __atomic_fetch_add(&metrics->field, (n), __ATOMIC_RELAXED)
+
+
+// Create the shared counters and fork the server listening on socket_path.
+// msqid is the message queue whose depth is reported, or -1.
+void metrics_start(const char *socket_path, long pairs_total, int msqid);
+
+
+// Attach to counters created by another process's metrics_start() (for workers)
+void metrics_attach(int shmid);
+
+
+// Shared memory id of the counters, to hand to workers
+int metrics_shmid();
+
+
+// Stop the server, unlink the socket and remove the shared memory (coordinator only)
+void metrics_stop();
+
+
+// Record a finished pair with the given status
+void metrics_pair_done(int status);
+
+
+// Record the time it took to spawn a child
+void metrics_spawn_latency(long long latency_us);
+
+#endif // METRICS_H
@@ -0,0 +1,75 @@
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdio.h>
+
+/*
+Streaming parameter sources. Parameters used to come only from argv; now they
+can also come from
+
+    --params-file <path>                one parameter per line, read a line at a time
+    --params-range <start>..<end>[:<step>]   e.g. 1..100000:7 (end is inclusive)
+    --params-random <n>:<lo>..<hi>[@<seed>]  n reproducible random integers in [lo, hi]
+
+Parameters are arbitrary byte strings (a file line may hold anything but '\n').
+Only the current parameter is ever held in memory: the source is re-read
+(rewound) whenever the full list is needed again, e.g. to label the columns of
+results.txt. Random samples are generated from (seed, index) so they replay
+identically on every pass.
+*/
+
+// Longest parameter label used in output file names and results.txt columns.
+// Longer or non-printable parameters are labelled "#<index>" instead.
+#define PARAM_LABEL_MAX 16
+
+enum {
+    PARAM_ARGV = 1,     // Positional arguments
+    PARAM_FILE,         // --params-file
+    PARAM_RANGE,        // --params-range
+    PARAM_RANDOM        // --params-random
+};
+
+typedef struct {
+    int kind;
+    long count;             // Total number of parameters
+    long next;              // Index of the next parameter to be returned
+
+    char **argv;            // PARAM_ARGV: the parameters
+
+    char *path;             // PARAM_FILE: file and its read position
+    FILE *fp;
+
+    long long start, step;  // PARAM_RANGE: start + next * step
+    long long lo, hi;       // PARAM_RANDOM: inclusive bounds ...
+    unsigned long long seed;  // ... and seed
+
+    char *buf;              // Current parameter (NUL-terminated, may contain NULs)
+    size_t buf_size;
+} param_source_t;
+
+
+// Build the parameter source from the --params-* options (removing them from argv)
+// or, if there are none, from the positional arguments argv[first_param..argc-1].
+// Exits with a message if the options are malformed.
+param_source_t *param_source_from_args(int *argc, char **argv, int first_param);
+
+
+// Return the next parameter and store its length in *len, or NULL at the end.
+// The returned buffer is owned by the source and is valid until the next call.
+char *param_source_next(param_source_t *src, int *len);
+
+
+// Start over from the first parameter
+void param_source_rewind(param_source_t *src);
+
+
+// Close the source and free it
+void param_source_close(param_source_t *src);
+
+
+// Write the label of parameter number idx to label (at least PARAM_LABEL_MAX + 1 bytes).
+// Short printable parameters label themselves, anything else becomes "#<idx + 1>".
+// Example: "42" -> "42", "hello world" -> "#3"
+void param_label(char *label, const char *param, int len, long idx);
+
+#endif // PARAMS_H
@@ -0,0 +1,43 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+/*
+Early termination (--fail-fast, --pass-threshold, --max-crashes).
+
+For pass/fail gates an executable's remaining parameters don't need to run
+once its verdict can't change. Its outcomes are tallied as they come in, and
+before each parameter the executables whose verdict is decided are left out;
+their cells get the SKIPPED outcome ("skipped" in results.txt). An executable
+is decided once any enabled policy fires:
+
+    --fail-fast             it got anything but "correct"
+    --pass-threshold <f>    even passing every remaining parameter can't bring
+                            it to a score of f (0.8 or 80%)
+    --max-crashes <k>       it crashed (segfault) k times
+
+A skipped cell is never correct, so the score of a stopped executable is the
+one it gets if every skipped parameter fails: with --pass-threshold it stays
+below the threshold, as it has to.
+*/
+
+// Outcomes of one executable so far
+typedef struct {
+    int tested;             // Parameters with an outcome (not skipped)
+    int failed;             // ... that weren't correct
+    int crashes;            // ... that crashed
+} policy_tally_t;
+
+
+// Take the policy options out of argv (see take_option()). Exits if malformed.
+void policy_from_args(int *argc, char **argv);
+
+
+// Count the outcome status of one parameter into tally
+void policy_record(policy_tally_t *tally, int status);
+
+
+// 1 once the verdict of an executable with tally can't change any more, out of
+// total_params parameters -> skip the rest
+int policy_decided(const policy_tally_t *tally, int total_params);
+
+#endif // POLICY_H
@@ -0,0 +1,59 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdio.h>
+
+/*
+Warm worker pool (mq_pool) and its client (mq_submit).
+
+mq_autograder creates a message queue and launches its workers for every run,
+and each worker is exec()ed and handshaken with before the first pair runs.
+mq_pool does that once: it owns the queue and num_workers = get_batch_size()
+workers started with --persistent, which run one job after another, and takes
+jobs from mq_submit over a Unix socket. Pairs go to the workers like in
+mq_autograder (round robin, see utils.h), without the ACK/SYNACK handshake:
+the workers are already waiting for them.
+
+A request is a sequence of NUL-terminated strings:
+
+    <solutions dir (absolute)> <number of parameters> <parameter> ...
+
+The answer is a sequence of lines:
+
+    EXE <executable path>           every executable of the job, in order
+    RESULT <path> <idx> <status> <run time in us>
+                                    every pair as its worker reports it
+                                    (the result message of worker.c)
+    END                             the job is done; pairs without a RESULT
+                                    couldn't be tested
+    ERROR <message>                 instead of all of the above
+
+Jobs run one at a time, in the order they connect, so a client that stalls
+holds up every job behind it: one that doesn't send its request, or doesn't
+read its answer, for POOL_CLIENT_SECS is dropped. The grading options
+(--expected, --compare, --stage and the limits, see contain.h) are the pool's,
+and its workers write their output files relative to the pool's directory.
+SIGINT/SIGTERM stop the pool after the current job: the workers are told to
+exit and the queue and socket are removed.
+*/
+
+// How long the pool waits on a client's socket before dropping it
+#define POOL_CLIENT_SECS 10
+
+// Message of type PAIRS_MTYPE(worker id) that tells a persistent worker to exit
+#define POOL_EXIT_MSG "EXIT"
+
+
+// Listen on a Unix socket at path (replacing a stale one), exit on failure
+int pool_listen(const char *path);
+
+
+// Connect to the pool listening at path, exit on failure
+int pool_connect(const char *path);
+
+
+// Read the next NUL-terminated string of a request into *buf (see getdelim()),
+// returns its length or -1 at the end of the request
+long pool_read_string(FILE *fp, char **buf, size_t *cap);
+
+#endif // POOL_H
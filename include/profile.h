@@ -0,0 +1,123 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+Harness overhead profile (--profile).
+
+Every pair's wall time is split into phases, timed with CLOCK_MONOTONIC in
+nanoseconds:
+
+    spawn       fork() until the grader gets on with the next child
+    exec        the child calling exec() until the new program runs: the child
+                writes the time into a close-on-exec pipe just before exec(),
+                and the grader waits for the pipe to close
+    run         the student's program, from there until it exits
+    harvest     its exit (when SIGCHLD reaches the grader) until it is reaped
+    evaluate    reading and parsing its output (or the comparison verdict)
+    store       recording the result (in mq_autograder, once it has arrived)
+    release     killing what the child left running and cleaning up its cgroup
+    report      (worker) sending the result to mq_autograder
+    deliver     (mq_autograder) the result waiting in the message queue
+
+Waiting for the exec handshake serializes spawns a little, like posix_spawn()
+does, so the batch starts slightly more staggered than without --profile.
+
+Each phase is aggregated into a log-bucketed histogram (HDR style: 2^PROFILE_SUB_BITS
+linear sub-buckets per power of two, so every value is kept to within 1/16)
+and the table of count, mean, percentiles and max is printed at the end of the
+run. Like the metrics counters, the histograms live in System V shared memory
+so the workers of mq_autograder add to the coordinator's (--profile-shm <shmid>).
+
+When profiling is off, profile is NULL and every hook is a single branch.
+*/
+
+enum {
+    PROFILE_SPAWN,
+    PROFILE_EXEC,
+    PROFILE_RUN,
+    PROFILE_HARVEST,
+    PROFILE_EVALUATE,
+    PROFILE_STORE,
+    PROFILE_RELEASE,
+    PROFILE_REPORT,
+    PROFILE_DELIVER,
+    PROFILE_PHASES
+};
+
+// Sub-buckets per power of two are 2^PROFILE_SUB_BITS
+#define PROFILE_SUB_BITS 4
+#define PROFILE_BUCKETS ((64 - PROFILE_SUB_BITS + 1) << PROFILE_SUB_BITS)
+
+typedef struct {
+    long count;
+    long sum_ns;
+    long max_ns;
+    long buckets[PROFILE_BUCKETS];
+} profile_hist_t;
+
+typedef struct {
+    profile_hist_t phases[PROFILE_PHASES];
+} profile_t;
+
+// Shared histograms, NULL when profiling is disabled
+extern profile_t *profile;
+
+#define PROFILE_ON (profile != NULL)
+
+
+// Create the shared histograms (coordinator)
+void profile_start();
+
+
+// Attach to histograms created by another process's profile_start() (for workers)
+void profile_attach(int shmid);
+
+
+// Shared memory id of the histograms, to hand to workers
+int profile_shmid();
+
+
+// Print the histograms to fp and remove the shared memory (coordinator), or just
+// detach (workers, fp NULL)
+void profile_stop(FILE *fp);
+
+
+// Current CLOCK_MONOTONIC time in nanoseconds
+long long profile_now();
+
+
+// Add one value to the histogram of phase
+void profile_record(int phase, long long ns);
+
+
+// Record phase as lasting from start until now, and return now
+long long profile_since(int phase, long long start);
+
+
+// The children of the next batch will run as pids[0..n-1] (zeroed here). Their exits
+// are noticed from a SIGCHLD handler, so pids must stay valid until the next call,
+// which is profile_batch(NULL, 0) once the batch is done.
+void profile_batch(pid_t *pids, int n);
+
+
+// Before fork(): create the exec handshake pipe of a child (both ends -1 when off)
+void profile_exec_pipe(int fds[2]);
+
+
+// In the child, right before exec()
+void profile_exec_begin(int fds[2]);
+
+
+// In the parent after fork(): record the spawn (since spawn_start) and exec phases
+// of the child in slot
+void profile_spawned(int slot, int fds[2], long long spawn_start);
+
+
+// Right after the child in slot was reaped: record its run and harvest phases, and
+// return now (the start of evaluating it)
+long long profile_reaped(int slot);
+
+#endif // PROFILE_H
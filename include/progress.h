@@ -0,0 +1,50 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include "utils.h"
+
+/*
+Progressive grading (--progressive).
+
+Instead of in order, the parameters are tested in rounds. The first round is
+a stratified random sample of about 1/PROGRESS_FIRST_FRACTION of them: the
+parameter list is cut into that many equal strata and one parameter is drawn
+from each. Every following round doubles the number of strata and draws from
+the strata that have no tested parameter yet, so all parameters tested so far
+are again a stratified sample. The last round tests whatever is left.
+
+After every round but the last, each executable gets a provisional score in
+scores.txt:
+
+    <exe_name>: <score> [<low>, <high>] <tested>/<total>
+
+where score is the fraction of its tested parameters that were correct and
+[low, high] the 95% Wilson score interval of the full-matrix score, narrowed
+with the finite population correction (it closes up as the sample grows to
+every parameter). results.txt shows the untested cells as "unknown". Both
+files are replaced atomically after each round; the last round writes the
+usual final scores.
+*/
+
+// Denominator of the first round's share of the parameters
+#define PROGRESS_FIRST_FRACTION 16
+
+// Most rounds of any plan (the number of strata doubles every round)
+#define PROGRESS_MAX_ROUNDS 64
+
+// Seed of the random draws within the strata, so runs are reproducible
+#define PROGRESS_SEED 1
+
+
+// Plan the rounds for n parameters: order gets all n parameter indices in the order
+// they are tested, round_ends[r] the number tested after round r. Returns the
+// number of rounds.
+int progress_plan(int n, int *order, int *round_ends);
+
+
+// Write provisional scores to scores.txt, once the parameters order[0..num_tested-1]
+// (of total_params) have been tested on every executable
+void progress_write_scores(autograder_results_t *results, int num_executables, const int *order,
+                           int num_tested, int total_params);
+
+#endif // PROGRESS_H
@@ -0,0 +1,78 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdio.h>
+
+/*
+Simulated executor (--simulate <trace>).
+
+No processes are run: every (executable, parameter) pair gets the outcome and
+run time the trace has for it, on a virtual clock. The trace is
+
+    <file>                  a history file (see history.h), e.g. recorded by a
+                            real run with --history; its pairs are replayed
+                            and the pairs it doesn't have are made up
+    synthetic:<n>[@<seed>]  made up for n executables sol_1 ... sol_n: each
+                            executable gets a share of correct answers and a
+                            typical run time, each pair a log-normal run time
+                            around it and an outcome
+
+The executables are the ones the trace names, under the solutions directory
+from the command line (which isn't read), so workloads of any size can be
+graded in seconds. Only the executor is swapped (executor_t in autograder.c,
+which otherwise spawns and harvests the children); everything above it runs as
+usual, so results.txt, scores.txt and the makespan come out as a real run with
+these run times would produce them: a batch takes as long as its slowest pair,
+and a pair that reaches the timeout is stuck.
+
+The pairs are also recorded in the order they ran, and at the end the same
+pairs are replayed under other dispatch policies, all with batch_size cores:
+
+    window      batch_size slots, each starting the next pair as soon as its
+                pair is done
+    mq          mq_autograder: batch_size workers, pairs dealt round robin,
+                each worker running lockstep batches of PAIRS_BATCH_SIZE (see utils.h)
+    steal       like mq, but a worker that has run out of pairs takes half of
+                the pairs left to the worker with the most
+
+mq and steal run more children than cores; the cores are shared equally among
+the running children (processor sharing), and a child still running when its
+batch's timeout fires is killed.
+*/
+
+// Typical run time of a synthetic executable (median over all of them)
+#define SIM_MEDIAN_US 20000
+
+extern int sim_on;
+
+#define SIM_ON (sim_on)
+
+
+// Load the trace spec (see above), exits if malformed
+void sim_open(const char *spec);
+
+
+// Paths (testdir/<name>) of the trace's executables, like get_student_executables()
+char **sim_executables(char *testdir, int *num_executables);
+
+
+// Outcome and run time of exe (name) on the parameter label
+void sim_pair(const char *exe, const char *label, int *status, long long *duration_us);
+
+
+// Record a pair as run (its run time, or stuck if it reached timeout_us), for the replay
+void sim_record(long long duration_us, int stuck, long long timeout_us);
+
+
+// Current virtual time in microseconds, and advance it
+long long sim_now();
+void sim_advance(long long us);
+
+
+// Print the makespan of the recorded pairs under each dispatch policy
+void sim_report(FILE *fp, int batch_size);
+
+
+void sim_close();
+
+#endif // SIM_H
@@ -0,0 +1,42 @@
+#ifndef STAGE_H
+#define STAGE_H
+
+/*
+Executable staging (--stage).
+
+Without staging every exec() resolves the executable's path and faults the
+binary in from the solutions directory, which stalls children (the first
+batch in particular) when that is a network share. With staging each
+executable is copied once into a sealed memfd and children are started from
+it with fexecve(), keeping the argv[0] they would have had.
+
+When the executables are discovered the kernel is asked to read all of them
+ahead (posix_fadvise(WILLNEED), which doesn't block), and while a batch runs
+the executables of the next batch are staged, so neither stalls a spawn.
+Before each use the executable is stat()ed again, and one that was replaced or
+modified since it was staged is staged again.
+
+Scripts (#!) aren't staged: the interpreter needs a path to open. They, and
+anything that couldn't be staged (e.g. out of file descriptors), run from
+their path as before.
+*/
+
+// Turn staging on for the n executables in paths and start reading them ahead
+void stage_init(char **paths, int n);
+
+
+// memfd with the current contents of the executable at path, staging it now if it
+// isn't yet or has changed. -1 to run it from its path instead (always, without
+// stage_init()).
+int stage_fd(char *path);
+
+
+// In the child: exec the staged copy fd (from stage_fd()) with argv. Only returns if
+// fd is -1 or fexecve() failed, so the caller can exec() the path as usual.
+void stage_exec(int fd, char **argv);
+
+
+// Close every staged executable
+void stage_free();
+
+#endif // STAGE_H
@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+Chrome/Perfetto trace-event export (--trace <file>).
+
+Events are written in the JSON Array Format, one object per line. The closing
+']' is optional in that format, so the coordinator writes the opening '[' and
+every process (autograder, mq_autograder, worker) simply appends events to the
+same file with O_APPEND. Each event goes out in a single write(), so lines
+from different processes never interleave.
+
+pid is the real process id and tid is the concurrency slot (or worker id), so
+every slot/worker gets its own track in the timeline. Timestamps are
+CLOCK_MONOTONIC microseconds, which are comparable across processes.
+
+When tracing is off, trace_fd is -1 and every hook is a single branch.
+*/
+
+// File descriptor of the trace file, -1 when tracing is disabled
+extern int trace_fd;
+
+#define TRACE_ON (trace_fd != -1)
+
+// Open the trace file. The coordinator passes truncate = 1 (which also writes
+// the opening '['), workers pass 0 and append to the coordinator's file.
+void trace_open(const char *path, int truncate);
+
+
+// Close the trace file (no-op when tracing is disabled)
+void trace_close();
+
+
+// Name the current process and one of its tracks in the timeline
+void trace_process_name(const char *name);
+void trace_thread_name(int tid, const char *name);
+
+
+// Complete ("X") event covering [start_us, end_us] on track tid.
+// exe and param are attached as args and may be NULL.
+void trace_span(const char *name, int tid, long long start_us, long long end_us,
+                const char *exe, const char *param);
+
+
+// Instant ("i") event on track tid, detail is attached as an arg and may be NULL
+void trace_instant(const char *name, int tid, const char *detail);
+
+#endif // TRACE_H
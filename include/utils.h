@@ -1,6 +1,10 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     // For pipe2() and other Linux extensions
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -18,6 +22,8 @@
 #include <sys/ipc.h>
 #include <sys/msg.h>
 
+#include "params.h"
+
 
 #define TIMEOUT_SECS 10    // Timeout threshold for stuck/infinite loop
 
@@ -25,14 +31,23 @@
 // Message queue msgtyp for general messages between mq_autograder and worker
 #define BROADCAST_MTYPE 4061  
 
+// Workers send their ACK, results and DONE to mq_autograder with their worker id as
+// msgtyp (1, 2, ...), so it can wait for any of them at once (msgtyp -num_workers).
+// Pairs go the other way with PAIRS_MTYPE(worker id), above all of those.
+#define PAIRS_MTYPE(worker_id) (BROADCAST_MTYPE + (worker_id))
+
 // Size of message queue message -> max size of executable path sent/received
 #define MESSAGE_SIZE 100
+
+// Workers run their (executable, parameter) pairs in batches of 8 to avoid timeouts
+// due to having too many child processes running at once
+#define PAIRS_BATCH_SIZE 8
 /************************* ONLY FOR MESSAGE QUEUES *************************/
 
-// Main struct for storing the results of the autograder
+// Main struct for storing the results of the autograder. Parameters aren't
+// stored here - status[i] belongs to the i-th parameter of the param_source_t.
 typedef struct {
     char *exe_path;       // path to executable
-    int *params_tested;   // array of parameters tested
     int *status;          // array of exit status codes for each parameter
 } autograder_results_t;
 
@@ -48,8 +63,12 @@ typedef struct {
 enum {
     CORRECT = 1,            // Corresponds to case 1: Exit with status 0 (correct answer)
     INCORRECT,              // Corresponds to case 2: Exit with status 1 (incorrect answer)
-    SEGFAULT,               // Corresponds to case 3: Triggering a segmentation fault
-    STUCK_OR_INFINITE       // Corresponds to case 4 and 5: Stuck, or in an infinite loop
+    SEGFAULT,               // Corresponds to case 3: Triggering a segmentation fault (or any other crash)
+    STUCK_OR_INFINITE,      // Corresponds to case 4 and 5: Stuck, or in an infinite loop
+    OUT_OF_MEMORY,          // Exceeded --mem-limit
+    OUTPUT_LIMIT_EXCEEDED,  // Wrote more than --output-limit bytes
+    PROCESS_LIMIT_EXCEEDED, // Tried to run more than --proc-limit processes
+    SKIPPED                 // Not run, the executable's verdict was already decided (see policy.h)
 };
 
 
@@ -61,18 +80,44 @@ char *get_exe_name(char *path);
 // Example: CORRECT -> "correct"
 const char* get_status_message(int status);
 
+// Outcome of a program that exited normally and printed output (NUL-terminated):
+// the CORRECT or INCORRECT it printed (see template.c), INCORRECT for anything else
+// Example: answer_status("1\n") -> CORRECT
+int answer_status(const char *output);
+
 // Takes in path to solutions directory and integer address for storing the 
 // total number of executables in the solutions directory. Returns a malloc'd
 // array of strings containing the executable paths.
 char **get_student_executables(char *solution_dir, int *num_executables);
 
 
+// Remove "<name> <value>" from argv (anywhere after argv[0]) and return value,
+// or NULL if the option isn't present. *argc is updated accordingly, so the
+// positional arguments can still be read as argv[1], argv[2], ...
+// Example: take_option(&argc, argv, "--trace") -> "out.json"
+char *take_option(int *argc, char **argv, const char *name);
+
+
+// Remove the flag "<name>" from argv like take_option(), returns 1 if it was present
+// Example: take_flag(&argc, argv, "--watch") -> 1
+int take_flag(int *argc, char **argv, const char *name);
+
+
+// Current CLOCK_MONOTONIC time in microseconds (async-signal-safe)
+long long get_time_us();
+
+
+// Parse the size spec given for option: bytes with an optional K, M or G suffix,
+// exits with a message if malformed. Example: parse_size("--mem-limit", "512M")
+long long parse_size(const char *option, const char *spec);
+
+
 // Count the number of times the pattern "processor" occurs in /proc/cpuinfo
 int get_batch_size();
 
 
-// Create the input/<input>.in files for each parameter
-void create_input_files(char **argv_params, int num_parameters);
+// Create the input/<label>.in file holding the len bytes of param (see params.h for labels)
+void create_input_file(char *label, char *param, int len);
 
 
 // Setup timer to determine if child processes are stuck
@@ -83,14 +128,26 @@ void start_timer(int seconds, void (*timeout_handler)(int));
 void cancel_timer();
 
 
-// Unlink all of the input/<input>.in files
-void remove_input_files(char **argv_params, int num_parameters);
+// Unlink the input/<label>.in file
+void remove_input_file(char *label);
 
 
-// Unlink all of the output/<executable>.<param> files in the current batch
+// Unlink all of the output/<executable>.<param> files in the current batch (the ones
+// that exist)
 void remove_output_files(autograder_results_t *results, int tested, int current_batch_size, char *param);
 
 
+// Files written by write_results_to_file() and write_scores_to_file() (and updated in
+// place by update_results_row() and update_score_line()), results.txt and scores.txt
+// unless set otherwise (see jobs.h)
+extern char *results_path;
+extern char *scores_path;
+
+
+// Length of the longest executable name (the width of the name column)
+int get_longest_len_executable(autograder_results_t *results, int num_executables);
+
+
 /*
 Writes autograder_results_t to a file called results.txt
 
@@ -100,8 +157,25 @@ Here is the format (this will be useful for implementing the scores() function):
 <exe_name:strlen(longest_exe_name)>:<p1:5> (<status1:9>)<p2:5> (<status2:9>)...<pN:5> (<statusN:9>)
 
 where N is the number of parameters tested and all fields are right-aligned except for exe_name.
+<pi> is the label of the parameter (see params.h), so it is wider than 5 when the label is,
+but the same in every row. The parameters are re-read from params.
+
+The rows are sorted by the number at the end of exe_name (after the last '_'), and
+executables with the same number keep their order in results. results itself isn't
+reordered, so indices into it stay valid (see results_row_order()).
 */
-void write_results_to_file(autograder_results_t *results, int num_executables, int total_params);
+void write_results_to_file(autograder_results_t *results, int num_executables, param_source_t *params);
+
+
+// Indices into results in the order of the rows of results.txt and scores.txt (malloc'd)
+int *results_row_order(autograder_results_t *results, int num_executables);
+
+
+// Rewrite the row of results[i] in results.txt in place with pwrite(), which works
+// because every row has the same width (see above). results must still have the same
+// executables and parameters as when results.txt was written. Returns -1 if
+// results.txt doesn't have that layout (then write it again with write_results_to_file()).
+int update_results_row(autograder_results_t *results, int num_executables, int i, param_source_t *params);
 
 
 /*
@@ -133,4 +207,8 @@ where <exe_name> is the name of the executable and <score> is the score of the e
 */
 void write_scores_to_file(autograder_results_t *results, int num_executables, char *results_file);
 
+
+// Rewrite the line of results[i] in scores.txt in place, like update_results_row()
+int update_score_line(autograder_results_t *results, int num_executables, int i, char *results_file);
+
 #endif // UTILS_H
@@ -0,0 +1,54 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/*
+Timeout verification.
+
+With more children than cores (--concurrency), a correct program can reach the
+timeout only because it didn't get a core often enough. So when the timeout
+handler fires, it first records how long each child still running has waited
+on a run queue (/proc/<pid>/schedstat, the kernel's run-delay accounting) and
+how many tasks were runnable (/proc/loadavg). A child killed at the timeout was
+starved if it waited for a core at least 1/VERIFY_STARVED_SHARE of its run.
+Without schedstat, it was starved if there were more runnable tasks than cores,
+it used at least half of its fair share of them (so it was running, not blocked)
+and less than (1 - 1/VERIFY_STARVED_SHARE) of its wall time.
+
+A starved pair's verdict isn't final: once its parameter's batches are done it
+is run again alone, with nothing else running, and that run's outcome counts.
+Blocked and genuinely infinite programs don't wait on run queues (or have a
+core to themselves), so they are stuck after one timeout as before.
+*/
+
+// A timed-out child was starved if it waited for a core 1/VERIFY_STARVED_SHARE of its run
+#define VERIFY_STARVED_SHARE 10
+
+// Timeouts rechecked and rechecks that didn't time out again, in this process
+extern long verify_rechecks;
+extern long verify_overturned;
+
+
+// Set up for batches of up to slots children
+void verify_init(int slots);
+
+
+// In the timeout handler, before the children are killed: record how many tasks are
+// runnable (async-signal-safe)
+void verify_snapshot_load();
+
+
+// ... and how long the child pid in slot has waited for a core (async-signal-safe)
+void verify_snapshot(int slot, pid_t pid);
+
+
+// Whether the child in slot, killed at the timeout after running for wall_us with
+// usage, was starved rather than stuck (see above)
+int verify_starved(int slot, long long wall_us, struct rusage *usage);
+
+
+void verify_free();
+
+#endif // VERIFY_H
@@ -0,0 +1,29 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <signal.h>
+
+/*
+Watching the solutions directory for new or changed executables (--watch).
+
+inotify reports files that were written, moved in or chmod'ed. Uploads are
+debounced: a file is only reported once nothing has happened to it for
+WATCH_SETTLE_MS, so a partly written upload (or one that hasn't been made
+executable yet) is never run. Hidden files are ignored, like in
+get_student_executables(), so uploads written to a dot file and renamed into
+place are picked up once, under their final name.
+*/
+
+// Quiet time after the last event on a file before it is reported
+#define WATCH_SETTLE_MS 1000
+
+// Start watching dir, returns the inotify file descriptor (exits on failure)
+int watch_open(const char *dir);
+
+
+// Wait until some files have changed and settled. Returns a malloc'd array of
+// their malloc'd names (*count of them), or NULL as soon as *stop is set (e.g. by
+// a SIGINT handler).
+char **watch_wait(int fd, int *count, volatile sig_atomic_t *stop);
+
+#endif // WATCH_H
@@ -0,0 +1,90 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <sys/types.h>
+
+/*
+The coordinator's side of the mq workers (worker.c), shared by mq_autograder
+and mq_pool: launching a worker, and keeping track of which worker owns each
+pair so the pairs of one that dies go to another.
+
+Pairs are numbered by the coordinator. Each has the worker it was last sent
+to, or none. When a worker dies, its pairs whose results haven't come back are
+orphaned. The orphans go, all at once, to a slot the coordinator says is idle
+(a worker that finished its pairs), or else to a dead slot that is launched
+again, at most WORKER_RESPAWN_LIMIT times per pairs_t.
+*/
+
+// Most workers launched to take over from workers that died
+#define WORKER_RESPAWN_LIMIT 4
+
+// A worker testing pairs that sends nothing for this long is hung (it sends the
+// results of every batch, and a batch is over after TIMEOUT_SECS)
+#define WORKER_HEARTBEAT_SECS (3 * TIMEOUT_SECS)
+
+// What the coordinator hands every worker (see worker.c's usage)
+typedef struct {
+    char *trace_path;         // --trace, NULL if off
+    int metrics_shmid;        // --metrics-shm, -1 if off
+    int profile_shmid;        // --profile-shm, -1 if off
+    char *expected_dir;       // --expected, NULL if off
+    char *compare_spec;       // --compare, NULL for the default
+    int staging;              // --stage
+    int persistent;           // --persistent (see pool.h); such a worker also ignores Ctrl-C
+} worker_options_t;
+
+// Slot states for pairs_orphan_slot()
+enum { SLOT_BUSY, SLOT_IDLE, SLOT_DEAD };
+
+typedef struct {
+    int num_pairs;
+    int *owner;               // Worker each pair was last sent to, -1 while it has none
+    char *done;               // 1 once the pair's result has come back
+    int num_done;
+    int *orphaned;            // Unfinished pairs of dead workers that no worker has yet
+    int num_orphaned;
+    int respawns;             // Dead slots launched again for orphans so far
+} pairs_t;
+
+
+// fork() and exec() ./worker <msqid> <worker_id> with options, returns its pid. Exits
+// if fork() fails.
+pid_t worker_spawn(int msqid, int worker_id, const worker_options_t *options);
+
+
+// Kill the worker pid (worker id worker_id) if it is testing pairs but was last heard
+// from at heard_at (see get_time_us()), more than WORKER_HEARTBEAT_SECS ago. Returns 1
+// if it was killed; the caller reaps it.
+int worker_kill_if_hung(pid_t pid, int worker_id, long long heard_at);
+
+
+// Start tracking num_pairs pairs, none of them sent yet
+void pairs_init(pairs_t *pairs, int num_pairs);
+
+
+// Pair p was sent to worker w, or orphan it if w is -1 (it couldn't be sent)
+void pairs_assign(pairs_t *pairs, int p, int w);
+
+
+// The result of pair p came back, returns 1 unless it already had
+int pairs_finish(pairs_t *pairs, int p);
+
+
+// Worker w died: orphan its unfinished pairs, returns how many
+int pairs_orphan(pairs_t *pairs, int w);
+
+
+// Slot of num_workers to give the orphans to, -1 if there are none or no slot can
+// take them. state(w) is the SLOT_* state of slot w; picking a SLOT_DEAD one counts
+// as a respawn.
+int pairs_orphan_slot(pairs_t *pairs, int num_workers, int (*state)(int w));
+
+
+// Take all orphans off the list, in pair order: returns them (malloc'd) and their
+// number in *n. If they can't be sent, pairs_assign() orphans them again.
+int *pairs_take_orphans(pairs_t *pairs, int *n);
+
+
+void pairs_free(pairs_t *pairs);
+
+#endif // WORKERS_H
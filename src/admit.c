@@ -0,0 +1,97 @@
+#include "utils.h"
+#include "contain.h"
+#include "hash.h"
+#include "admit.h"
+
+long long admit_budget_kb;
+long admit_limited;
+long admit_oversized;
+
+long long admit_default_kb = ADMIT_DEFAULT_KB;  // Estimate of pairs nothing is known about
+
+// Largest peak RSS of each executable so far in this run
+typedef struct {
+    char *exe_path;         // Key (see hash.h)
+    long rss_kb;
+} peak_t;
+
+hash_table_t peaks;         // peak_t on the path, set up by the first admit_observe()
+
+
+void admit_from_args(int *argc, char **argv) {
+    char *budget = take_option(argc, argv, "--mem-budget");
+    char *estimate = take_option(argc, argv, "--mem-estimate");
+
+    if (budget != NULL)
+        admit_budget_kb = parse_size("--mem-budget", budget) / 1024;
+    if (estimate != NULL) {
+        admit_default_kb = parse_size("--mem-estimate", estimate) / 1024;
+    } else if (contain_limits.memory > 0) {
+        // A child can't get past its limit
+        admit_default_kb = contain_limits.memory / 1024;
+    }
+    if ((budget != NULL && admit_budget_kb == 0) || admit_default_kb == 0) {
+        fprintf(stderr, "--mem-budget and --mem-estimate need at least 1K\n");
+        exit(1);
+    }
+}
+
+
+long long admit_estimate(history_t *history, const char *exe_path, const char *label) {
+    history_entry_t *entry = history != NULL ? history_lookup(history, get_exe_name((char *) exe_path), label) : NULL;
+    if (entry != NULL && entry->rss_kb > 0)
+        return entry->rss_kb;
+
+    peak_t *peak = hash_table_find(&peaks, exe_path, NULL);
+    if (peak != NULL)
+        return peak->rss_kb;
+    return admit_default_kb;
+}
+
+
+void admit_observe(const char *exe_path, long rss_kb) {
+    if (rss_kb <= 0)
+        return;
+
+    if (peaks.capacity == 0)
+        hash_table_init(&peaks, sizeof(peak_t), 1, 256);
+
+    peak_t *peak = hash_table_insert(&peaks, exe_path, NULL);
+    if (rss_kb > peak->rss_kb)
+        peak->rss_kb = rss_kb;
+}
+
+
+int admit_batch(int *order, int n, int batch_size, long long (*estimate)(int, void *), void *arg) {
+    if (n <= 1 || batch_size <= 1)
+        return n < 1 ? n : 1;
+
+    // The next pair goes in whatever it needs
+    long long left = admit_budget_kb - estimate(order[0], arg);
+    if (left < 0)
+        admit_oversized++;
+
+    // First fit among the next pairs; the ones passed over move back, in order
+    int admitted = 1, passed_over = 0;
+    for (int k = 1; k < n && k <= ADMIT_LOOKAHEAD && admitted < batch_size && left > 0; k++) {
+        long long need = estimate(order[k], arg);
+        if (need > left) {
+            passed_over = 1;
+            continue;
+        }
+        left -= need;
+
+        int picked = order[k];
+        memmove(&order[admitted + 1], &order[admitted], (k - admitted) * sizeof(int));
+        order[admitted++] = picked;
+    }
+
+    if (passed_over || (admitted < batch_size && admitted < n))
+        admit_limited++;
+    return admitted;
+}
+
+
+void admit_free() {
+    hash_table_free(&peaks);
+}
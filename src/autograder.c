@@ -1,4 +1,19 @@
 #include "utils.h"
+#include "trace.h"
+#include "metrics.h"
+#include "compare.h"
+#include "contain.h"
+#include "history.h"
+#include "watch.h"
+#include "stage.h"
+#include "progress.h"
+#include "policy.h"
+#include "profile.h"
+#include "jobs.h"
+#include "sim.h"
+#include "verify.h"
+#include "admit.h"
+#include "delta.h"
 
 // Batch size is determined at runtime now
 pid_t *pids;
@@ -8,11 +23,80 @@ autograder_results_t *results;
 
 int num_executables;      // Number of executables in test directory
 int curr_batch_size;      // At most batch_size executables will be run at once
-int total_params;         // Total number of parameters to test - (argc - 2)
+int total_params;         // Total number of parameters to test (see params.h)
+int timeout_secs = TIMEOUT_SECS;  // Timeout of the programs (per job with --jobs)
 
 // Contains status of child processes (-1 for done, 1 for still running)
 int *child_status;
 
+// Trace timestamps (only taken with --trace, see trace.h)
+long long *spawned_at;        // When each child of the batch was forked
+volatile long long batch_killed_at;  // When the timeout handler fired for this batch (0 if it didn't)
+
+#define TIMING_ON (TRACE_ON || METRICS_ON || history != NULL)
+
+// Expected-output comparison (only with --expected, see compare.h)
+char *expected_dir;           // Directory of golden files (NULL when comparison is off)
+int compare_mode;
+double compare_tol;
+golden_t *golden;             // Digest of the current parameter's golden file
+int *out_fds;                 // Read end of each child's stdout pipe
+compare_t *cmps;              // Comparison state of each child's output
+
+// Input files (--input-dir, see feed.h)
+char *input_dir;              // Directory of <label>.in input files (NULL to use the parameter itself)
+int input_fd = -1;            // Current parameter's input file (PIPE mode)
+long long input_size;
+feed_t *feeds;                // Input delivery of each child (PIPE mode)
+
+// Scheduling (only with --history, see history.h)
+history_t *history;           // Run times of previous runs (NULL without --history)
+int *exe_order;               // Executables in the order they run on the current parameter
+long long *predicted;         // Predicted run time of each executable on the current parameter
+
+// Early termination (see policy.h)
+policy_tally_t *tallies;      // Outcomes so far of each executable
+
+// Timeout verification (see verify.h)
+int *rechecks;                // Executables that timed out starved on the current parameter
+int num_rechecks;
+int rechecking;               // 1 while they run again
+
+// Watch mode (--watch, see watch.h)
+volatile sig_atomic_t watch_stop;   // Set by SIGINT/SIGTERM
+
+// Several jobs (--jobs, see jobs.h)
+int num_jobs;                 // 0 without --jobs
+
+// Result deltas (--delta, see delta.h)
+FILE *delta_out;              // NULL without --delta
+
+// Where the pairs run: spawning and reaping children, or the trace with --simulate
+// (see sim.h). Everything above it is the same either way.
+typedef struct {
+    // Paths of the executables in testdir (see get_student_executables()), ready to run
+    char **(*executables)(char *testdir, int *num_executables, int staging);
+
+    // Set up and clean up a parameter (param_len bytes at param, labelled label)
+    void (*begin)(char *param, int param_len, char *label);
+    void (*end)(char *label);
+
+    // Run the batch exe_order[tested..tested+curr_batch_size-1] on parameter number i
+    // and record the outcomes (the next ones up to count may be prepared meanwhile)
+    void (*run)(int tested, int count, char *param, int param_len, char *label, int i, int batch_size);
+
+    // Current time in us
+    long long (*now)();
+} executor_t;
+
+executor_t *executor;
+
+
+// Current time in us, on the virtual clock with --simulate (see sim.h)
+long long clock_us() {
+    return executor->now();
+}
+
 
 // TODO (Change 3): Timeout handler for alarm signal - kill remaining running child processes
 void timeout_handler(int signum) {
@@ -25,9 +109,15 @@ void timeout_handler(int signum) {
         * Implement get_score()
     */
 
-    // Kill everything 
+    batch_killed_at = get_time_us();
+    verify_snapshot_load();
+
+    // Kill everything still running, along with whatever it spawned
     for (int i = 0; i < curr_batch_size; ++i) {
-        kill(pids[i], SIGKILL);
+        if (child_status != NULL && child_status[i] == 1) {
+            verify_snapshot(i, pids[i]);
+            contain_kill(pids[i], i);
+        }
     }
 
     // Reclaim resources
@@ -36,29 +126,53 @@ void timeout_handler(int signum) {
     // }
 }
 
-// Execute the student's executable using exec()
-void execute_solution(char *executable_path, char *input, int batch_idx) {
+// Execute the student's executable using exec(). input is input_len bytes long and
+// label is its parameter label (used for the output and input file names).
+void execute_solution(char *executable_path, char *input, int input_len, char *label, int batch_idx) {
+    long long spawn_start = TIMING_ON ? get_time_us() : 0;
+    long long spawn_start_ns = PROFILE_ON ? profile_now() : 0;
+
+    #if defined(EXEC) || defined(REDIR) || defined(PIPE)
+        // Staged copy of the executable (only with --stage, see stage.h)
+        int exe_fd = stage_fd(executable_path);
+    #endif
+
+    // Output is compared as it streams in -> stdout goes to a pipe
+    int outpipe[2];
+    if (golden != NULL && pipe2(outpipe, O_CLOEXEC) == -1) {
+        perror("couldn't create output pipe");
+        exit(1);
+    }
+
     #ifdef PIPE
         // TODO: Setup pipe
         int pipefd[2];
-        if (pipe(pipefd) == -1) {
-            perror("couldn't create pipes");
-            exit(1);
-        }
+        feed_pipe(pipefd);
     #endif
+
+    // Tells when the program starts running (only with --profile, see profile.h)
+    int handshake[2];
+    profile_exec_pipe(handshake);
     
     pid_t pid = fork();
 
     // Child process
     if (pid == 0) {
+        contain_enter(batch_idx);
+
+        #ifdef PIPE
+            // The grader ignores SIGPIPE for its input pipes, the child shouldn't
+            signal(SIGPIPE, SIG_DFL);
+        #endif
+
         char *executable_name = get_exe_name(executable_path);
 
         int print_fd = STDOUT_FILENO;
 
         // TODO (Change 1): Redirect STDOUT to output/<executable>.<input> file
         char output_file[BUFSIZ];
-        sprintf(output_file, "output/%s.%s", executable_name, input);
-        int output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        sprintf(output_file, "output/%s.%s", executable_name, label);
+        int output_fd = golden != NULL ? outpipe[1] : open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
         if (output_fd == -1) {  
             perror("open");
             exit(1);
@@ -74,6 +188,8 @@ void execute_solution(char *executable_path, char *input, int batch_idx) {
         #ifdef EXEC
                     
         // printf("%s %s %s\n", executable_path, executable_name, input);
+        profile_exec_begin(handshake);
+        stage_exec(exe_fd, (char *[]) { executable_name, input, NULL });
         execlp(executable_path, executable_name, input, (char *) NULL);
         
         #elif REDIR
@@ -81,7 +197,7 @@ void execute_solution(char *executable_path, char *input, int batch_idx) {
         // TODO: Redirect STDIN to input/<input>.in file
 
         char input_file[BUFSIZ];
-        sprintf(input_file, "input/%s.in", input);
+        sprintf(input_file, "%s/%s.in", input_dir != NULL ? input_dir : "input", label);
         printf("%s\n", input_file);
         int input_fd = open(input_file, O_RDONLY | O_CREAT, 0666);
 
@@ -97,6 +213,8 @@ void execute_solution(char *executable_path, char *input, int batch_idx) {
         }
         
         // printf("%s %s %s\n", executable_path, executable_name, input);
+        profile_exec_begin(handshake);
+        stage_exec(exe_fd, (char *[]) { executable_name, NULL });
         execlp(executable_path, executable_name, (char *) NULL);
 
         #elif PIPE
@@ -108,6 +226,8 @@ void execute_solution(char *executable_path, char *input, int batch_idx) {
         char fd_str[10];  // Buffer to hold the string representation of the file descriptor
         sprintf(fd_str, "%d", pipefd[0]);  // Convert the file descriptor to a string
         
+        profile_exec_begin(handshake);
+        stage_exec(exe_fd, (char *[]) { executable_name, fd_str, NULL });
         execlp(executable_path, executable_name, fd_str, (char *) NULL);
         
         #endif
@@ -121,15 +241,34 @@ void execute_solution(char *executable_path, char *input, int batch_idx) {
         #ifdef PIPE
             // TODO: Send input to child process via pipe 
             close(pipefd[0]);
-            write(pipefd[1], input, strlen(input));
-            close(pipefd[1]); // Signal EOF 
 
-            // Store the PID for later
-            pids[batch_idx] = pid;
-            
+            // Whatever doesn't fit into the pipe now is delivered by compare_drain()
+            if (input_fd != -1) {
+                feed_start(&feeds[batch_idx], pipefd[1], input_fd, NULL, input_size);
+            } else {
+                feed_start(&feeds[batch_idx], pipefd[1], -1, input, input_len);
+            }
         #endif
 
         pids[batch_idx] = pid;
+        contain_adopt(pid);
+        profile_spawned(batch_idx, handshake, spawn_start_ns);
+
+        if (golden != NULL) {
+            close(outpipe[1]);
+            out_fds[batch_idx] = outpipe[0];
+            compare_init(&cmps[batch_idx], golden);
+        }
+
+        // Always taken, timeouts are verified against it (see verify.h)
+        spawned_at[batch_idx] = get_time_us();
+        if (TIMING_ON) {
+            trace_span("spawn", batch_idx, spawn_start, spawned_at[batch_idx],
+                       get_exe_name(executable_path), label);
+            metrics_spawn_latency(spawned_at[batch_idx] - spawn_start);
+        }
+        if (METRICS_ON)
+            METRICS_ADD(in_flight, 1);
     }
     // Fork failed
     else {
@@ -147,19 +286,50 @@ void monitor_and_evaluate_solutions(int tested, char *param, int param_idx) {
         child_status[j] = 1;
     }
 
+    // Reaped-at times of each slot, so idle time behind the slowest child can be traced
+    long long *reaped_at = TRACE_ON ? malloc(curr_batch_size * sizeof(long long)) : NULL;
+
+    // Compare the outputs as they stream in (and stop children that already failed),
+    // delivering their input meanwhile
+    if (golden != NULL || feeds != NULL) {
+        compare_drain(curr_batch_size, golden != NULL ? out_fds : NULL, cmps, feeds, pids, &batch_killed_at);
+    }
+
     // MAIN EVALUATION LOOP: Wait until each process has finished or timed out
-    for (int j = 0; j < curr_batch_size; j++) {
+    for (int reaped = 0; reaped < curr_batch_size; reaped++) {
 
         int status;
-        pid_t pid = waitpid(pids[j], &status, 0);
+        struct rusage usage;
+        // Reap children in the order they finish (not batch order) so each slot's
+        // run time is accurate
+        pid_t pid = wait4(-1, &status, 0, &usage);
 
         // TODO: What if waitpid is interrupted by a signal?
 
         // Keep waiting for children while interrupted
         while (pid == -1 && errno == EINTR) {
-            pid = waitpid(pids[j], &status, 0);
+            pid = wait4(-1, &status, 0, &usage);
         }
 
+        if (pid == -1) {
+            perror("Failed to wait for child process");
+            exit(1);
+        }
+
+        // Find the batch slot of the reaped child
+        int j = 0;
+        while (j < curr_batch_size && pids[j] != pid) {
+            j++;
+        }
+        if (j == curr_batch_size || child_status[j] == -1) {
+            // Not one of ours -> doesn't count towards the batch
+            reaped--;
+            continue;
+        }
+
+        long long harvest_start = TRACE_ON ? get_time_us() : 0;
+        long long evaluate_start = profile_reaped(j);
+
         // TODO: Determine if the child process finished normally, segfaulted, or timed out
         int exit_status = WEXITSTATUS(status);
         int exited = WIFEXITED(status);
@@ -171,135 +341,927 @@ void monitor_and_evaluate_solutions(int tested, char *param, int param_idx) {
             
             if (signal_number == SIGKILL) {
                 // Child process was killed by the alarm
-                results[tested - curr_batch_size + j].status[param_idx] = STUCK_OR_INFINITE;
-            } else if (signal_number == SIGSEGV) {
-                // Child process triggered a segmentation fault
-                write(STDERR_FILENO, "seg\n", 4);
-                results[tested - curr_batch_size + j].status[param_idx] = SEGFAULT;
+                results[exe_order[tested - curr_batch_size + j]].status[param_idx] = STUCK_OR_INFINITE;
+            } else {
+                // Child process triggered a segmentation fault, or crashed some other way
+                // (abort(), a division by zero, a bus error...)
+                if (signal_number == SIGSEGV)
+                    write(STDERR_FILENO, "seg\n", 4);
+                results[exe_order[tested - curr_batch_size + j]].status[param_idx] = SEGFAULT;
+            }
+        }
+
+        // With --expected the verdict comes from the output comparison instead
+        if (golden != NULL) {
+            if (cmps[j].over_limit) {
+                results[exe_order[tested - curr_batch_size + j]].status[param_idx] = OUTPUT_LIMIT_EXCEEDED;
+            } else if (cmps[j].killed) {
+                // Killed because of the mismatch - that's not a timeout
+                results[exe_order[tested - curr_batch_size + j]].status[param_idx] = INCORRECT;
+            } else if (!signaled) {
+                results[exe_order[tested - curr_batch_size + j]].status[param_idx] = cmps[j].finished && !cmps[j].mismatch ? CORRECT : INCORRECT;
             }
         }
 
         // TODO: Also, update the results struct with the status of the child process
-        char output_file[BUFSIZ];
-        char* filename = strrchr(results[tested - curr_batch_size + j].exe_path, '/');
-        if (filename != NULL) {
-            ++filename;
+        if (golden == NULL && !signaled) {
+            char output_file[BUFSIZ];
+            char* filename = strrchr(results[exe_order[tested - curr_batch_size + j]].exe_path, '/');
+            if (filename != NULL) {
+                ++filename;
+            }
+            sprintf(output_file, "output/%s.%s", filename, param);
+            int output_fd = open(output_file, O_RDONLY);
+            if (output_fd == -1) {  
+                perror("open");
+                exit(1);
+            }
+            char buffer[BUFSIZ];
+            ssize_t num_bytes = read(output_fd, buffer, sizeof(buffer) - 1);
+            if (num_bytes == -1) {
+                perror("read");
+                exit(1);
+            }
+
+            buffer[num_bytes] = '\0';  // Null-terminate the buffer
+            results[exe_order[tested - curr_batch_size + j]].status[param_idx] = answer_status(buffer);
+            close(output_fd);
         }
-        sprintf(output_file, "output/%s.%s", filename, param);
-        int output_fd = open(output_file, O_RDONLY);
-        if (output_fd == -1) {  
-            perror("open");
-            exit(1);
+
+        // A child that ran into one of its limits gets that outcome, whatever it printed
+        int limit_status = contain_limit_status(j, status, &usage);
+        if (limit_status != 0) {
+            results[exe_order[tested - curr_batch_size + j]].status[param_idx] = limit_status;
         }
-        char buffer[BUFSIZ];
-        ssize_t num_bytes = read(output_fd, buffer, sizeof(buffer));
-        if (num_bytes == -1) {
-            perror("read");
-            exit(1);
+
+        // A timeout while starved for CPU isn't a verdict yet: the pair runs again alone
+        // once the parameter's batches are done (see verify.h)
+        int timed_out = signaled && WTERMSIG(status) == SIGKILL && batch_killed_at != 0
+                        && (golden == NULL || !cmps[j].killed);
+        int starved = 0;
+        if (rechecking) {
+            if (results[exe_order[tested - curr_batch_size + j]].status[param_idx] != STUCK_OR_INFINITE) {
+                verify_overturned++;
+                if (METRICS_ON)
+                    METRICS_ADD(timeout_overturned, 1);
+            }
+        } else if (timed_out && results[exe_order[tested - curr_batch_size + j]].status[param_idx] == STUCK_OR_INFINITE
+                   && verify_starved(j, batch_killed_at - spawned_at[j], &usage)) {
+            starved = 1;
+            rechecks[num_rechecks++] = exe_order[tested - curr_batch_size + j];
+            results[exe_order[tested - curr_batch_size + j]].status[param_idx] = 0;
+            verify_rechecks++;
+            if (METRICS_ON)
+                METRICS_ADD(timeout_rechecks, 1);
         }
+        long long store_start = profile_since(PROFILE_EVALUATE, evaluate_start);
 
-        if (num_bytes != 0) {
-            buffer[num_bytes] = '\0';  // Null-terminate the buffer
-            results[tested - curr_batch_size + j].status[param_idx] = atoi(buffer);
+        if (history != NULL && !starved) {
+            history_record(history, get_exe_name(results[exe_order[tested - curr_batch_size + j]].exe_path), param,
+                           results[exe_order[tested - curr_batch_size + j]].status[param_idx],
+                           get_time_us() - spawned_at[j], usage.ru_maxrss);
+        }
+        if (ADMIT_ON)
+            admit_observe(results[exe_order[tested - curr_batch_size + j]].exe_path, usage.ru_maxrss);
+        if (!starved) {
+            policy_record(&tallies[exe_order[tested - curr_batch_size + j]],
+                          results[exe_order[tested - curr_batch_size + j]].status[param_idx]);
         }
-        close(output_fd);
+        long long release_start = profile_since(PROFILE_STORE, store_start);
 
         // NOTE: Make sure you are using the output/<executable>.<input> file to determine the status
         //       of the child process, NOT the exit status like in Project 1.
 
 
-        // Adding tested parameter to results struct
-        results[tested - curr_batch_size + j].params_tested[param_idx] = atoi(param);
+        // Anything the child left running is killed now; it only counts as a leak
+        // if we hadn't already killed the whole tree ourselves
+        int tree_killed = (signaled && WTERMSIG(status) == SIGKILL && batch_killed_at != 0)
+                          || (golden != NULL && cmps[j].killed);
+        contain_release(pid, j, tree_killed,
+                        get_exe_name(results[exe_order[tested - curr_batch_size + j]].exe_path), param);
+        profile_since(PROFILE_RELEASE, release_start);
 
         // Mark the process as finished
         child_status[j] = -1;
+
+        if (METRICS_ON) {
+            METRICS_ADD(in_flight, -1);
+            if (timed_out)
+                METRICS_ADD(timeout_kills, 1);
+            if (!starved)
+                metrics_pair_done(results[exe_order[tested - curr_batch_size + j]].status[param_idx]);
+        }
+
+        if (TRACE_ON) {
+            char *exe_name = get_exe_name(results[exe_order[tested - curr_batch_size + j]].exe_path);
+            trace_span("run", j, spawned_at[j], harvest_start, exe_name, param);
+            if (signaled && WTERMSIG(status) == SIGKILL && batch_killed_at != 0) {
+                trace_span("timeout-kill", j, batch_killed_at, harvest_start, exe_name, param);
+            }
+            reaped_at[j] = get_time_us();
+            trace_span("harvest", j, harvest_start, reaped_at[j], exe_name, param);
+        }
+    }
+
+    // Every slot sits idle from its own harvest until the whole batch is done
+    if (TRACE_ON) {
+        long long batch_end = get_time_us();
+        for (int j = 0; j < curr_batch_size; j++) {
+            trace_span("idle", j, reaped_at[j], batch_end, NULL, param);
+        }
+        free(reaped_at);
     }
 
     free(child_status);
+    child_status = NULL;
+}
+
+// Set up testing results[which[0..count-1]] on parameter number i (param_len bytes at
+// param, labelled label): the executables to run go into exe_order, expected to take
+// longest first (directory order without history) and without those whose verdict is
+// already decided, and the golden output and input are prepared. Returns how many
+// executables there are to run; unless none, end_parameter() must follow.
+int begin_parameter(int *which, int count, char *param, int param_len, int i, char *label) {
+    int runnable = 0;
+    for (int e = 0; e < count; e++) {
+        if (policy_decided(&tallies[which[e]], total_params)) {
+            results[which[e]].status[i] = SKIPPED;
+            metrics_pair_done(SKIPPED);
+            continue;
+        }
+        exe_order[runnable++] = which[e];
+        predicted[which[e]] = history != NULL ? history_predict(history, get_exe_name(results[which[e]].exe_path), label) : 0;
+    }
+    count = runnable;
+    if (count == 0)
+        return 0;
+
+    if (history != NULL) {
+        history_sort(exe_order, predicted, count);
+    }
+    executor->begin(param, param_len, label);
+    return count;
+}
+
+
+// Set up running children on a parameter: the golden output and the input
+void begin_processes(char *param, int param_len, char *label) {
+    // Digest the golden output once for all executables
+    if (expected_dir != NULL) {
+        golden = golden_load(expected_dir, label, compare_mode, compare_tol);
+    }
+
+    #ifdef REDIR
+        // TODO: Create the input/<input>.in files and write the parameters to them
+        if (input_dir == NULL)
+            create_input_file(label, param, param_len);  // Implement this function (src/utils.c)
+    #endif
+
+    #ifdef PIPE
+        // Every child is fed from the same file (at its own offset)
+        if (input_dir != NULL) {
+            char input_file[PATH_MAX];
+            snprintf(input_file, sizeof(input_file), "%s/%s.in", input_dir, label);
+            struct stat st;
+            if ((input_fd = open(input_file, O_RDONLY | O_CLOEXEC)) == -1 || fstat(input_fd, &st) == -1) {
+                fprintf(stderr, "No input for parameter %s: ", label);
+                perror(input_file);
+                exit(1);
+            }
+            input_size = st.st_size;
+        }
+    #endif
+}
+
+
+// Estimated peak RSS of results[e] on the parameter labelled label (see admit.h)
+long long estimate_rss(int e, void *label) {
+    return admit_estimate(history, results[e].exe_path, label);
+}
+
+
+// Run the next batch of at most batch_size of exe_order[tested..count-1] on parameter
+// number i (see begin_parameter()), returns how many were run
+int run_batch(int tested, int count, char *param, int param_len, char *label, int i, int batch_size) {
+    // Determine current batch size - min(remaining, batch_size), or as many as fit
+    // into the memory budget
+    int remaining = count - tested;
+    curr_batch_size = remaining < batch_size ? remaining : batch_size;
+    if (ADMIT_ON)
+        curr_batch_size = admit_batch(exe_order + tested, remaining, batch_size, estimate_rss, label);
+
+    executor->run(tested, count, param, param_len, label, i, batch_size);
+    return curr_batch_size;
+}
+
+
+// Spawn the batch as children, wait for them and evaluate them (see executor_t)
+void run_processes(int tested, int count, char *param, int param_len, char *label, int i, int batch_size) {
+    pids = malloc(curr_batch_size * sizeof(pid_t));
+    spawned_at = malloc(curr_batch_size * sizeof(long long));
+    batch_killed_at = 0;
+    profile_batch(pids, curr_batch_size);
+    if (golden != NULL) {
+        out_fds = malloc(curr_batch_size * sizeof(int));
+        cmps = malloc(curr_batch_size * sizeof(compare_t));
+    }
+    #ifdef PIPE
+        feeds = malloc(curr_batch_size * sizeof(feed_t));
+    #endif
+
+    #ifdef REDIR
+        // Another job's parameter of the same label may have replaced the input file since
+        if (input_dir == NULL && num_jobs > 0 && tested > 0)
+            create_input_file(label, param, param_len);
+    #endif
+
+    // TODO: Execute the programs in batch size chunks
+    for (int j = 0; j < curr_batch_size; j++) {
+        execute_solution(results[exe_order[tested]].exe_path, param, param_len, label, j);
+        tested++;
+    }
+
+    // TODO (Change 3): Setup timer to determine if child process is stuck
+    start_timer(timeout_secs, timeout_handler);  // Implement this function (src/utils.c)
+
+    // Stage the next batch's executables while this one runs (see stage.h)
+    for (int k = tested; k < count && k < tested + batch_size; k++) {
+        stage_fd(results[exe_order[k]].exe_path);
+    }
+
+    // TODO: Wait for the batch to finish and check results
+    monitor_and_evaluate_solutions(tested, label, i);
+
+    // TODO: Cancel the timer if all child processes have finished
+    if (child_status == NULL) {
+        cancel_timer();  // Implement this function (src/utils.c)
+    }
+
+    // TODO Unlink all output files in current batch (output/<executable>.<input>)
+    // remove_output_files(results, tested, curr_batch_size, label);  // Implement this function (src/utils.c)
+
+    profile_batch(NULL, 0);
+    free(pids);
+    pids = NULL;
+    free(spawned_at);
+    if (golden != NULL) {
+        free(out_fds);
+        free(cmps);
+    }
+    free(feeds);
+    feeds = NULL;
+}
+
+
+// Run the executables that timed out starved on parameter number i again, one at a
+// time with nothing else running, for their final verdict (see verify.h)
+void recheck_starved(char *param, int param_len, char *label, int i) {
+    int count = num_rechecks;
+    if (count == 0)
+        return;
+
+    // exe_order is free again once the parameter's batches are done
+    memcpy(exe_order, rechecks, count * sizeof(int));
+    num_rechecks = 0;
+    rechecking = 1;
+    for (int tested = 0; tested < count; ) {
+        tested += run_batch(tested, count, param, param_len, label, i, 1);
+    }
+    rechecking = 0;
+}
+
+
+// Clean up after begin_parameter()
+void end_parameter(char *label) {
+    executor->end(label);
+}
+
+
+// Clean up after begin_processes()
+void end_processes(char *label) {
+    golden_free(golden);
+    golden = NULL;
+
+    #ifdef REDIR
+        // TODO: Unlink all input files for REDIR case (<input>.in)
+        if (input_dir == NULL)
+            remove_input_file(label);  // Implement this function (src/utils.c)
+    #endif
+
+    #ifdef PIPE
+        if (input_fd != -1) {
+            close(input_fd);
+            input_fd = -1;
+        }
+    #endif
+}
+
+
+// The executables of testdir, staged with --stage (see stage.h)
+char **find_executables(char *testdir, int *num_executables, int staging) {
+    char **paths = get_student_executables(testdir, num_executables);
+    if (staging) {
+        stage_init(paths, *num_executables);
+    }
+    return paths;
+}
+
+
+// Like run_processes(), but with the outcomes and run times of the trace: the batch
+// takes as long as its slowest pair, and pairs that reach the timeout are stuck (see sim.h)
+void simulate_batch(int tested, int count, char *param, int param_len, char *label, int param_idx,
+                    int batch_size) {
+    long long timeout_us = timeout_secs * 1000000LL, longest = 0;
+    for (int j = 0; j < curr_batch_size; j++) {
+        int e = exe_order[tested + j], status;
+        long long duration_us;
+        sim_pair(get_exe_name(results[e].exe_path), label, &status, &duration_us);
+
+        int stuck = status == STUCK_OR_INFINITE || duration_us >= timeout_us;
+        if (stuck) {
+            status = STUCK_OR_INFINITE;
+            duration_us = timeout_us;
+        }
+        results[e].status[param_idx] = status;
+        policy_record(&tallies[e], status);
+        metrics_pair_done(status);
+        sim_record(duration_us, stuck, timeout_us);
+        if (duration_us > longest)
+            longest = duration_us;
+    }
+    sim_advance(longest);
+}
+
+
+// The trace's executables (see sim.h); nothing runs, so nothing is staged
+char **simulated_executables(char *testdir, int *num_executables, int staging) {
+    return sim_executables(testdir, num_executables);
+}
+
+
+// A simulated parameter needs neither golden output nor input
+void simulate_begin(char *param, int param_len, char *label) {
+}
+
+
+void simulate_end(char *label) {
+}
+
+
+executor_t process_executor = { find_executables, begin_processes, end_processes, run_processes, get_time_us };
+executor_t sim_executor = { simulated_executables, simulate_begin, simulate_end, simulate_batch, sim_now };
+
+
+// Test results[which[0..count-1]] on parameter number i (param_len bytes at param, which
+// must stay unchanged until then), returns the predicted makespan (0 without --history)
+long long grade_parameter(int *which, int count, char *param, int param_len, int i, int batch_size) {
+    long long predicted_makespan = 0;
+
+    char label[PARAM_LABEL_MAX + 1];
+    param_label(label, param, param_len, i);
+
+    count = begin_parameter(which, count, param, param_len, i, label);
+    if (count == 0)
+        return 0;
+    if (history != NULL) {
+        predicted_makespan = history_makespan(exe_order, predicted, count, batch_size);
+    }
+
+    // Test the parameter on each executable
+    for (int tested = 0; tested < count; ) {
+        tested += run_batch(tested, count, param, param_len, label, i, batch_size);
+    }
+    recheck_starved(param, param_len, label, i);
+
+    end_parameter(label);
+    return predicted_makespan;
+}
+
+
+// Test results[which[0..count-1]] on every parameter, returns the predicted makespan
+// (0 without --history)
+long long grade_executables(int *which, int count, param_source_t *params, int batch_size) {
+    long long predicted_makespan = 0;
+
+    // MAIN LOOP: For each parameter, run the executables in batch size chunks.
+    // Parameters are streamed from the source one at a time.
+    param_source_rewind(params);
+    char *param;
+    int param_len;
+    for (int i = 0; (param = param_source_next(params, &param_len)) != NULL; i++) {
+        predicted_makespan += grade_parameter(which, count, param, param_len, i, batch_size);
+    }
+
+    return predicted_makespan;
+}
+
+
+// Like grade_executables(), but in rounds of stratified samples of the parameters
+// with provisional scores after each round (see progress.h)
+long long grade_progressively(int *which, int count, param_source_t *params, int batch_size) {
+    // The parameters are needed out of order -> keep them in memory
+    char **param_values = malloc(total_params * sizeof(char *));
+    int *param_lens = malloc(total_params * sizeof(int));
+    param_source_rewind(params);
+    char *param;
+    int param_len;
+    for (int i = 0; (param = param_source_next(params, &param_len)) != NULL; i++) {
+        param_values[i] = malloc(param_len + 1);
+        memcpy(param_values[i], param, param_len + 1);
+        param_lens[i] = param_len;
+    }
+
+    int *order = malloc(total_params * sizeof(int));
+    int round_ends[PROGRESS_MAX_ROUNDS];
+    int rounds = progress_plan(total_params, order, round_ends);
+
+    long long predicted_makespan = 0;
+    long long start = clock_us();
+    for (int r = 0, k = 0; r < rounds; r++) {
+        for (; k < round_ends[r]; k++) {
+            predicted_makespan += grade_parameter(which, count, param_values[order[k]], param_lens[order[k]],
+                                                  order[k], batch_size);
+        }
+
+        // The last round's scores are the final ones
+        if (r < rounds - 1) {
+            write_results_to_file(results, num_executables, params);
+            progress_write_scores(results, num_executables, order, round_ends[r], total_params);
+            printf("Round %d: %d/%d parameters tested after %.2f s, provisional scores in scores.txt\n",
+                   r + 1, round_ends[r], total_params, (clock_us() - start) / 1e6);
+            fflush(stdout);
+        }
+    }
+
+    for (int i = 0; i < total_params; i++) {
+        free(param_values[i]);
+    }
+    free(param_values);
+    free(param_lens);
+    free(order);
+    return predicted_makespan;
+}
+
+
+void watch_stop_handler(int signum) {
+    watch_stop = 1;
+}
+
+
+// Grade executables added to or changed in testdir (watched by watch_fd) until
+// SIGINT/SIGTERM. Their rows of results.txt and lines of scores.txt are rewritten in
+// place; only a new executable makes both files be written again.
+void watch_solutions(int watch_fd, char *testdir, param_source_t *params, int batch_size, char *history_path) {
+    // No SA_RESTART, so waiting for events stops right away
+    struct sigaction sa = {0};
+    sa.sa_handler = watch_stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("Watching %s for new solutions\n", testdir);
+    fflush(stdout);
+
+    char **names;
+    int num_names;
+    while ((names = watch_wait(watch_fd, &num_names, &watch_stop)) != NULL) {
+        long long round_start = get_time_us();
+        int *which = malloc(num_names * sizeof(int));
+        int count = 0;
+        int new_rows = 0;
+
+        for (int k = 0; k < num_names; k++) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", testdir, names[k]);
+            free(names[k]);
+
+            // Same files as get_student_executables(), once they can be run
+            struct stat st;
+            if (stat(path, &st) == -1 || !S_ISREG(st.st_mode) || access(path, X_OK) == -1)
+                continue;
+
+            int e = 0;
+            while (e < num_executables && strcmp(get_exe_name(results[e].exe_path), get_exe_name(path)) != 0) {
+                e++;
+            }
+            if (e == num_executables) {
+                results = realloc(results, (num_executables + 1) * sizeof(autograder_results_t));
+                results[e].exe_path = strdup(path);
+                results[e].status = malloc(total_params * sizeof(int));
+                num_executables++;
+                exe_order = realloc(exe_order, num_executables * sizeof(int));
+                predicted = realloc(predicted, num_executables * sizeof(long long));
+                tallies = realloc(tallies, num_executables * sizeof(policy_tally_t));
+                rechecks = realloc(rechecks, num_executables * sizeof(int));
+                new_rows = 1;
+            }
+            memset(&tallies[e], 0, sizeof(policy_tally_t));
+            which[count++] = e;
+        }
+        free(names);
+
+        if (count == 0) {
+            free(which);
+            continue;
+        }
+
+        if (METRICS_ON)
+            METRICS_ADD(pairs_total, (long) count * total_params);
+        grade_executables(which, count, params, batch_size);
+
+        // Rows first: the scores are computed from results.txt
+        delta_t *delta = delta_out != NULL ? delta_begin(results_path, scores_path) : NULL;
+        for (int k = 0; k < count && !new_rows; k++) {
+            if (update_results_row(results, num_executables, which[k], params) == -1)
+                new_rows = 1;
+        }
+        for (int k = 0; k < count && !new_rows; k++) {
+            if (update_score_line(results, num_executables, which[k], results_path) == -1)
+                new_rows = 1;
+        }
+        if (new_rows) {
+            // New executables (or a stale file) change the layout -> write both files again
+            write_results_to_file(results, num_executables, params);
+            write_scores_to_file(results, num_executables, results_path);
+        }
+        if (delta != NULL)
+            delta_end(delta, delta_out);
+
+        printf("Graded");
+        for (int k = 0; k < count; k++) {
+            printf(" %s", get_exe_name(results[which[k]].exe_path));
+        }
+        printf(" in %.2f s\n", (get_time_us() - round_start) / 1e6);
+        fflush(stdout);
+        free(which);
+
+        if (history != NULL)
+            history_save(history, history_path);
+    }
+
+    close(watch_fd);
+}
+
+
+// A job of --jobs and how far its grading has got. The grader's globals (results,
+// exe_order, golden, ...) point at the state of the job whose batch is running.
+typedef struct {
+    autograder_results_t *results;
+    int num_executables;
+    char **executable_paths;
+    int *everything;               // 0..num_executables-1
+    policy_tally_t *tallies;
+    int *rechecks;
+    int num_rechecks;
+    int *exe_order;
+    long long *predicted;
+    golden_t *golden;              // Of the current parameter
+    int input_fd;
+    long long input_size;
+    int param_idx;                 // Current parameter, -1 before the first
+    char *param;
+    int param_len;
+    char label[PARAM_LABEL_MAX + 1];
+    int count;                     // Executables to run on the current parameter
+    int tested;                    // ... run so far
+} job_run_t;
+
+
+// Point the grader's globals at the state of job (run)
+static void job_enter(job_t *job, job_run_t *run) {
+    results = run->results;
+    num_executables = run->num_executables;
+    total_params = job->params->count;
+    timeout_secs = job->timeout_secs;
+    if (history != NULL)
+        history->stuck_us = timeout_secs * 1000000LL;
+    tallies = run->tallies;
+    rechecks = run->rechecks;
+    num_rechecks = run->num_rechecks;
+    exe_order = run->exe_order;
+    predicted = run->predicted;
+    golden = run->golden;
+    input_fd = run->input_fd;
+    input_size = run->input_size;
+}
+
+
+// Save what the last batch changed of the current job's state
+static void job_leave(job_run_t *run) {
+    run->num_rechecks = num_rechecks;
+    run->golden = golden;
+    run->input_fd = input_fd;
+    run->input_size = input_size;
+    golden = NULL;
+    input_fd = -1;
 }
 
+
+// Write the results and scores of the current job, whose grading is done
+static void job_finish(job_t *job, long long start) {
+    results_path = job->results_path;
+    scores_path = job->scores_path;
+    delta_t *delta = job->delta_path != NULL ? delta_begin(results_path, scores_path) : NULL;
+    write_results_to_file(results, num_executables, job->params);
+    write_scores_to_file(results, num_executables, results_path);
+    if (delta != NULL) {
+        FILE *out = delta_open(job->delta_path);
+        delta_end(delta, out);
+        fclose(out);
+    }
+
+    printf("Job %s: %d executables x %d parameters done after %.2f s\n", job->name, num_executables,
+           total_params, (clock_us() - start) / 1e6);
+    fflush(stdout);
+}
+
+
+// Grade all jobs, one batch at a time for the job jobs_next() picks (see jobs.h)
+void grade_jobs(job_t *jobs, int batch_size, int staging) {
+    job_run_t *runs = calloc(num_jobs, sizeof(job_run_t));
+    for (int j = 0; j < num_jobs; j++) {
+        job_run_t *run = &runs[j];
+        run->executable_paths = executor->executables(jobs[j].testdir, &run->num_executables, staging);
+
+        run->results = malloc(run->num_executables * sizeof(autograder_results_t));
+        run->everything = malloc(run->num_executables * sizeof(int));
+        for (int e = 0; e < run->num_executables; e++) {
+            run->results[e].exe_path = run->executable_paths[e];
+            run->results[e].status = calloc(jobs[j].params->count, sizeof(int));
+            run->everything[e] = e;
+        }
+        run->tallies = calloc(run->num_executables, sizeof(policy_tally_t));
+        run->rechecks = malloc(run->num_executables * sizeof(int));
+        run->exe_order = malloc(run->num_executables * sizeof(int));
+        run->predicted = malloc(run->num_executables * sizeof(long long));
+        run->input_fd = -1;
+        run->param_idx = -1;
+        param_source_rewind(jobs[j].params);
+
+        if (METRICS_ON)
+            METRICS_ADD(pairs_total, (long) run->num_executables * jobs[j].params->count);
+    }
+
+    long long start = clock_us();
+    int j;
+    while ((j = jobs_next(jobs, num_jobs)) != -1) {
+        job_t *job = &jobs[j];
+        job_run_t *run = &runs[j];
+        job_enter(job, run);
+
+        // On to the job's next parameter
+        if (run->tested == run->count) {
+            run->param = param_source_next(job->params, &run->param_len);
+            if (run->param == NULL) {
+                job_finish(job, start);
+                job->done = 1;
+                job_leave(run);
+                continue;
+            }
+            run->param_idx++;
+            param_label(run->label, run->param, run->param_len, run->param_idx);
+            run->count = begin_parameter(run->everything, run->num_executables, run->param, run->param_len,
+                                         run->param_idx, run->label);
+            run->tested = 0;
+        }
+
+        if (run->count > 0) {
+            long long batch_start = clock_us();
+            int ran = run_batch(run->tested, run->count, run->param, run->param_len, run->label,
+                                run->param_idx, batch_size);
+            run->tested += ran;
+            jobs_charge(job, (clock_us() - batch_start) * ran);
+
+            if (run->tested == run->count) {
+                recheck_starved(run->param, run->param_len, run->label, run->param_idx);
+                end_parameter(run->label);
+            }
+        }
+        job_leave(run);
+    }
+
+    for (j = 0; j < num_jobs; j++) {
+        for (int e = 0; e < runs[j].num_executables; e++) {
+            free(runs[j].results[e].exe_path);
+            free(runs[j].results[e].status);
+        }
+        free(runs[j].results);
+        free(runs[j].executable_paths);
+        free(runs[j].everything);
+        free(runs[j].tallies);
+        free(runs[j].rechecks);
+        free(runs[j].exe_order);
+        free(runs[j].predicted);
+    }
+    free(runs);
+    results = NULL;
+    num_executables = 0;
+    tallies = NULL;
+    rechecks = NULL;
+    exe_order = NULL;
+    predicted = NULL;
+}
+
+
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        printf("Usage: %s <testdir> <p1> <p2> ... <pn>\n", argv[0]);
+    char *trace_path = take_option(&argc, argv, "--trace");
+    char *metrics_path = take_option(&argc, argv, "--metrics");
+    expected_dir = take_option(&argc, argv, "--expected");
+    char *compare_spec = take_option(&argc, argv, "--compare");
+    input_dir = take_option(&argc, argv, "--input-dir");
+    char *history_path = take_option(&argc, argv, "--history");
+    int watch = take_flag(&argc, argv, "--watch");
+    int staging = take_flag(&argc, argv, "--stage");
+    int progressive = take_flag(&argc, argv, "--progressive");
+    int profiling = take_flag(&argc, argv, "--profile");
+    contain_limits_from_args(&argc, argv);
+    policy_from_args(&argc, argv);
+    admit_from_args(&argc, argv);
+    char *jobs_path = take_option(&argc, argv, "--jobs");
+    char *sim_spec = take_option(&argc, argv, "--simulate");
+    char *concurrency = take_option(&argc, argv, "--concurrency");
+    char *delta_path = take_option(&argc, argv, "--delta");
+
+    if (sim_spec != NULL) {
+        if (watch) {
+            fprintf(stderr, "--simulate can't be combined with --watch\n");
+            return 1;
+        }
+        sim_open(sim_spec);
+    }
+    executor = SIM_ON ? &sim_executor : &process_executor;
+
+    job_t *jobs = NULL;
+    if (jobs_path != NULL) {
+        if (argc > 1 || watch || progressive || delta_path != NULL) {
+            fprintf(stderr, "--jobs takes the solutions and parameters from the job file"
+                    " and can't be combined with --watch, --progressive or --delta (see jobs.h)\n");
+            return 1;
+        }
+        jobs = jobs_load(jobs_path, &num_jobs);
+    }
+
+    param_source_t *params = jobs == NULL ? param_source_from_args(&argc, argv, 2) : NULL;
+
+    if (jobs == NULL && (argc < 2 || params->count == 0)) {
+        printf("Usage: %s [--trace <file>] [--metrics <socket>] [--expected <dir> [--compare <mode>]] [--input-dir <dir>] [--history <file>] [--watch] [--stage] [--progressive] [--profile] [--simulate <trace>] [--concurrency <n>] [--delta <file>] [--mem-budget <size> [--mem-estimate <size>]] [--fail-fast] [--pass-threshold <f>] [--max-crashes <k>] [--mem-limit <size>] [--output-limit <size>] [--proc-limit <n>] <testdir> <p1> <p2> ... <pn>\n", argv[0]);
+        printf("       %s [options] <testdir> --params-file <file> | --params-range <a>..<b>[:<step>]"
+               " | --params-random <n>:<lo>..<hi>[@<seed>]\n", argv[0]);
+        printf("       %s [options] --jobs <file>\n", argv[0]);
         return 1;
     }
 
-    char *testdir = argv[1];
-    total_params = argc - 2;
+    compare_parse_mode(compare_spec != NULL ? compare_spec : "exact", &compare_mode, &compare_tol);
 
     // TODO (Change 0): Implement get_batch_size() function
     int batch_size = get_batch_size();
+    if (concurrency != NULL && (batch_size = atoi(concurrency)) <= 0) {
+        fprintf(stderr, "Bad concurrency '%s'\n", concurrency);
+        return 1;
+    }
+    contain_init(batch_size);
+    verify_init(batch_size);
+
+    #ifdef PIPE
+        // A child that exits without reading all its input shows up as EPIPE (see feed.h)
+        signal(SIGPIPE, SIG_IGN);
+    #endif
+
+    if (trace_path != NULL) {
+        trace_open(trace_path, 1);
+        trace_process_name("autograder");
+        for (int j = 0; j < batch_size; j++) {
+            char slot_name[32];
+            sprintf(slot_name, "slot %d", j);
+            trace_thread_name(j, slot_name);
+        }
+    }
+
+    if (jobs != NULL) {
+        if (metrics_path != NULL) {
+            metrics_start(metrics_path, 0, -1);     // Counted up as the jobs are set up
+        }
+        if (profiling) {
+            profile_start();
+        }
+        if (history_path != NULL) {
+            history = history_load(history_path);
+        }
 
-    char **executable_paths = get_student_executables(testdir, &num_executables);
+        grade_jobs(jobs, batch_size, staging);
+        if (verify_rechecks > 0)
+            printf("Timeouts rechecked: %ld starved, %ld overturned\n", verify_rechecks, verify_overturned);
+        if (ADMIT_ON)
+            printf("Memory budget: %ld batches limited, %ld pairs over budget alone\n", admit_limited, admit_oversized);
+
+        if (SIM_ON) {
+            printf("Makespan: %.2f s (simulated)\n", sim_now() / 1e6);
+            sim_report(stdout, batch_size);
+            sim_close();
+        }
+        if (history != NULL) {
+            if (!SIM_ON)
+                history_save(history, history_path);
+            history_free(history);
+        }
+        jobs_free(jobs, num_jobs);
+        stage_free();
+        trace_close();
+        metrics_stop();
+        profile_stop(stdout);
+        verify_free();
+        admit_free();
+        contain_finish();
+        return 0;
+    }
+
+    char *testdir = argv[1];
+    total_params = params->count;
+
+    // Watch before listing, so nothing uploaded during the first run is missed
+    int watch_fd = watch ? watch_open(testdir) : -1;
+
+    char **executable_paths = executor->executables(testdir, &num_executables, staging);
 
     // Construct summary struct
     results = malloc(num_executables * sizeof(autograder_results_t));
     for (int i = 0; i < num_executables; i++) {
         results[i].exe_path = executable_paths[i];
-        results[i].params_tested = malloc((total_params) * sizeof(int));
-        results[i].status = malloc((total_params) * sizeof(int));
+        results[i].status = calloc(total_params, sizeof(int));     // "unknown" until tested
     }
 
-    #ifdef REDIR
-        // TODO: Create the input/<input>.in files and write the parameters to them
-        create_input_files(argv + 2, total_params);  // Implement this function (src/utils.c)
-        // fill file(s) with params in argv 
-    #endif
-    
-    // MAIN LOOP: For each parameter, run all executables in batch size chunks
-    for (int i = 2; i < argc; i++) {
-        int remaining = num_executables;
-	    int tested = 0;
-
-        // Test the parameter on each executable
-        while (remaining > 0) {
-
-            // Determine current batch size - min(remaining, batch_size)
-            curr_batch_size = remaining < batch_size ? remaining : batch_size;
-            pids = malloc(curr_batch_size * sizeof(pid_t));
-		
-            // TODO: Execute the programs in batch size chunks
-            for (int j = 0; j < curr_batch_size; j++) {
-                execute_solution(executable_paths[tested], argv[i], j);
-		        tested++;
-            }
-
-            // TODO (Change 3): Setup timer to determine if child process is stuck
-            start_timer(TIMEOUT_SECS, timeout_handler);  // Implement this function (src/utils.c)
+    if (metrics_path != NULL) {
+        metrics_start(metrics_path, (long) num_executables * total_params, -1);
+    }
+    if (profiling) {
+        profile_start();
+    }
 
-            // TODO: Wait for the batch to finish and check results
-            monitor_and_evaluate_solutions(tested, argv[i], i - 2);
+    if (history_path != NULL) {
+        history = history_load(history_path);
+    }
 
-            // TODO: Cancel the timer if all child processes have finished
-            if (child_status == NULL) {
-                cancel_timer();  // Implement this function (src/utils.c)
-            }
+    // Against the previous run's files, before --progressive replaces them
+    delta_t *delta = NULL;
+    if (delta_path != NULL) {
+        delta_out = delta_open(delta_path);
+        delta = delta_begin(results_path, scores_path);
+    }
+    exe_order = malloc(num_executables * sizeof(int));
+    predicted = malloc(num_executables * sizeof(long long));
+    tallies = calloc(num_executables, sizeof(policy_tally_t));
+    rechecks = malloc(num_executables * sizeof(int));
+    long long run_start = clock_us();
 
-            // TODO Unlink all output files in current batch (output/<executable>.<input>)
-            // remove_output_files(results, tested, curr_batch_size, argv[i]);  // Implement this function (src/utils.c)
+    int *everything = malloc(num_executables * sizeof(int));
+    for (int e = 0; e < num_executables; e++) {
+        everything[e] = e;
+    }
+    long long predicted_makespan = progressive ? grade_progressively(everything, num_executables, params, batch_size)
+                                               : grade_executables(everything, num_executables, params, batch_size);
+    free(everything);
 
-            // Adjust the remaining count after the batch has finished
-            remaining -= curr_batch_size;
-        }
+    if (SIM_ON) {
+        printf("Makespan: %.2f s (simulated)\n", (clock_us() - run_start) / 1e6);
+        sim_report(stdout, batch_size);
+    } else if (history != NULL) {
+        printf("Makespan: %.2f s (predicted %.2f s)\n", (get_time_us() - run_start) / 1e6, predicted_makespan / 1e6);
+        history_save(history, history_path);
     }
 
-    #ifdef REDIR
-        // TODO: Unlink all input files for REDIR case (<input>.in)
-        remove_input_files(argv + 2, total_params);  // Implement this function (src/utils.c)
-    #endif
+    if (verify_rechecks > 0)
+        printf("Timeouts rechecked: %ld starved, %ld overturned\n", verify_rechecks, verify_overturned);
+    if (ADMIT_ON)
+        printf("Memory budget: %ld batches limited, %ld pairs over budget alone\n", admit_limited, admit_oversized);
 
-    write_results_to_file(results, num_executables, total_params);
+    write_results_to_file(results, num_executables, params);
 
     // You can use this to debug your scores function
     // get_score("results.txt", results[0].exe_path);
 
     // Print each score to scores.txt
-    write_scores_to_file(results, num_executables, "results.txt");
+    write_scores_to_file(results, num_executables, results_path);
+
+    if (delta != NULL)
+        printf("Delta: %d rows changed\n", delta_end(delta, delta_out));
+
+    if (watch) {
+        watch_solutions(watch_fd, testdir, params, batch_size, history_path);
+    }
+
+    if (history != NULL) {
+        history_free(history);
+    }
+    if (delta_out != NULL)
+        fclose(delta_out);
+    sim_close();
+    free(exe_order);
+    free(predicted);
+    free(tallies);
+    free(rechecks);
 
     // Free the results struct and its fields
     for (int i = 0; i < num_executables; i++) {
         free(results[i].exe_path);
-        free(results[i].params_tested);
         free(results[i].status);
     }
 
@@ -307,6 +1269,15 @@ int main(int argc, char *argv[]) {
     free(executable_paths);
 
     free(pids);
+    param_source_close(params);
+    stage_free();
+
+    trace_close();
+    metrics_stop();
+    profile_stop(stdout);
+    verify_free();
+    admit_free();
+    contain_finish();
     
     return 0;
 }
\ No newline at end of file
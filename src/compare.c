@@ -0,0 +1,377 @@
+#include "utils.h"
+#include "compare.h"
+#include "contain.h"
+#include "hash.h"
+#include <poll.h>
+#include <math.h>
+#include <ctype.h>
+
+
+void compare_parse_mode(const char *spec, int *mode, double *tol) {
+    *tol = 1e-6;
+    if (strcmp(spec, "exact") == 0) {
+        *mode = COMPARE_EXACT;
+    } else if (strcmp(spec, "ws") == 0) {
+        *mode = COMPARE_WS;
+    } else if (strcmp(spec, "numeric") == 0 || strncmp(spec, "numeric:", 8) == 0) {
+        *mode = COMPARE_NUMERIC;
+        if (spec[7] == ':' && sscanf(spec + 8, "%lf", tol) != 1) {
+            fprintf(stderr, "Bad numeric tolerance in '%s'\n", spec);
+            exit(1);
+        }
+    } else {
+        fprintf(stderr, "Unknown compare mode '%s' (expected exact, ws or numeric[:tol])\n", spec);
+        exit(1);
+    }
+}
+
+
+/*
+The same stream processing is used to build a golden digest (building != NULL,
+hashes/tokens are appended to it) and to check a child's output against one.
+*/
+
+// A COMPARE_CHUNK-sized chunk of normalized output is complete (or the stream ended)
+static void chunk_done(compare_t *cmp, golden_t *building) {
+    long idx = (cmp->length - 1) / COMPARE_CHUNK;
+
+    if (building != NULL) {
+        if ((idx & (idx - 1)) == 0 || idx == 0) {
+            // Grow at powers of two
+            building->chunk_hashes = realloc(building->chunk_hashes, 2 * (idx + 1) * sizeof(unsigned long long));
+        }
+        building->chunk_hashes[idx] = cmp->hash;
+        building->num_chunks = idx + 1;
+    }
+    else if (idx >= cmp->golden->num_chunks || cmp->golden->chunk_hashes[idx] != cmp->hash) {
+        cmp->mismatch = 1;
+    }
+
+    cmp->hash = FNV_OFFSET;
+}
+
+
+// Next byte of normalized output
+static void chunk_byte(compare_t *cmp, golden_t *building, unsigned char c) {
+    cmp->hash = (cmp->hash ^ c) * FNV_PRIME;
+    cmp->length++;
+
+    if (cmp->length % COMPARE_CHUNK == 0)
+        chunk_done(cmp, building);
+}
+
+
+// A whitespace-separated token is complete
+static void token_done(compare_t *cmp, golden_t *building) {
+    cmp->token_text[cmp->token_len < 63 ? cmp->token_len : 63] = '\0';
+
+    // Only short tokens can be numbers - the text is cut at 63 characters
+    char *end;
+    double value = 0;
+    int is_num = 0;
+    if (cmp->token_len < 63) {
+        value = strtod(cmp->token_text, &end);
+        is_num = *end == '\0' && end != cmp->token_text && isfinite(value);
+    }
+
+    long idx = cmp->token_idx++;
+
+    if (building != NULL) {
+        if ((idx & (idx - 1)) == 0 || idx == 0) {
+            building->tokens = realloc(building->tokens, 2 * (idx + 1) * sizeof(golden_token_t));
+        }
+        building->tokens[idx].hash = cmp->token_hash;
+        building->tokens[idx].value = value;
+        building->tokens[idx].is_num = is_num;
+        building->num_tokens = idx + 1;
+    }
+    else if (idx >= cmp->golden->num_tokens) {
+        cmp->mismatch = 1;
+    }
+    else {
+        golden_token_t *expected = &cmp->golden->tokens[idx];
+        if (expected->is_num && is_num) {
+            double scale = fabs(expected->value) > 1.0 ? fabs(expected->value) : 1.0;
+            if (fabs(value - expected->value) > cmp->golden->tol * scale)
+                cmp->mismatch = 1;
+        } else if (expected->hash != cmp->token_hash) {
+            cmp->mismatch = 1;
+        }
+    }
+
+    cmp->token_hash = FNV_OFFSET;
+    cmp->token_len = 0;
+}
+
+
+static void process(compare_t *cmp, golden_t *building, int mode, const char *buf, ssize_t n) {
+    for (ssize_t i = 0; i < n && !cmp->mismatch; i++) {
+        unsigned char c = buf[i];
+
+        if (mode == COMPARE_EXACT) {
+            chunk_byte(cmp, building, c);
+        }
+        else if (mode == COMPARE_WS) {
+            if (isspace(c)) {
+                if (cmp->length > 0)
+                    cmp->pending_space = 1;
+            } else {
+                if (cmp->pending_space) {
+                    chunk_byte(cmp, building, ' ');
+                    cmp->pending_space = 0;
+                }
+                chunk_byte(cmp, building, c);
+            }
+        }
+        else {
+            if (isspace(c)) {
+                if (cmp->token_len > 0)
+                    token_done(cmp, building);
+            } else {
+                cmp->token_hash = (cmp->token_hash ^ c) * FNV_PRIME;
+                if (cmp->token_len < 63)
+                    cmp->token_text[cmp->token_len] = c;
+                cmp->token_len++;
+            }
+        }
+    }
+}
+
+
+// Flush whatever is left at the end of the stream
+static void finish(compare_t *cmp, golden_t *building, int mode) {
+    if (mode == COMPARE_NUMERIC) {
+        if (cmp->token_len > 0 && !cmp->mismatch)
+            token_done(cmp, building);
+    }
+    else if (cmp->length % COMPARE_CHUNK != 0 && !cmp->mismatch) {
+        chunk_done(cmp, building);
+    }
+}
+
+
+static void reset(compare_t *cmp, golden_t *golden) {
+    memset(cmp, 0, sizeof(compare_t));
+    cmp->golden = golden;
+    cmp->hash = FNV_OFFSET;
+    cmp->token_hash = FNV_OFFSET;
+}
+
+
+golden_t *golden_load(const char *dir, const char *label, int mode, double tol) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s.out", dir, label);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "No expected output for parameter %s: ", label);
+        perror(path);
+        exit(1);
+    }
+
+    golden_t *golden = calloc(1, sizeof(golden_t));
+    golden->mode = mode;
+    golden->tol = tol;
+
+    compare_t cmp;
+    reset(&cmp, NULL);
+
+    char buffer[BUFSIZ];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        process(&cmp, golden, mode, buffer, n);
+    }
+    if (n == -1) {
+        perror("Failed to read expected output");
+        exit(1);
+    }
+    close(fd);
+
+    finish(&cmp, golden, mode);
+    golden->length = cmp.length;
+
+    return golden;
+}
+
+
+void golden_free(golden_t *golden) {
+    if (golden == NULL)
+        return;
+
+    free(golden->chunk_hashes);
+    free(golden->tokens);
+    free(golden);
+}
+
+
+void compare_init(compare_t *cmp, golden_t *golden) {
+    reset(cmp, golden);
+}
+
+
+int compare_feed(compare_t *cmp, const char *buf, ssize_t n) {
+    if (cmp->mismatch)
+        return -1;
+
+    process(cmp, NULL, cmp->golden->mode, buf, n);
+
+    // Output longer than expected can't match either
+    if (cmp->golden->mode != COMPARE_NUMERIC && cmp->length > cmp->golden->length)
+        cmp->mismatch = 1;
+
+    return cmp->mismatch ? -1 : 0;
+}
+
+
+int compare_finish(compare_t *cmp) {
+    finish(cmp, NULL, cmp->golden->mode);
+    cmp->finished = 1;
+
+    if (cmp->golden->mode == COMPARE_NUMERIC) {
+        if (cmp->token_idx != cmp->golden->num_tokens)
+            cmp->mismatch = 1;
+    } else if (cmp->length != cmp->golden->length) {
+        cmp->mismatch = 1;
+    }
+
+    return cmp->mismatch ? INCORRECT : CORRECT;
+}
+
+
+// Has the child pid exited (without reaping it)?
+static int has_exited(pid_t pid) {
+    siginfo_t info;
+    info.si_pid = 0;
+    return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == pid;
+}
+
+
+// Count and compare the next n bytes of a child's output, returns 0 while it may still match
+static int take_output(compare_t *cmp, const char *buf, ssize_t n) {
+    cmp->bytes += n;
+    if (contain_limits.output > 0 && cmp->bytes > contain_limits.output) {
+        cmp->over_limit = 1;
+        cmp->mismatch = 1;
+        return -1;
+    }
+    return compare_feed(cmp, buf, n);
+}
+
+
+// Feed the rest of a pipe whose writer has exited, without waiting on processes it
+// left behind that still hold the write end. Returns 0 if it still matches.
+static int drain_exited(int fd, compare_t *cmp, char *buffer, size_t size) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (poll(&pfd, 1, 0) > 0) {
+        ssize_t bytes = read(fd, buffer, size);
+        if (bytes <= 0)
+            break;
+        if (take_output(cmp, buffer, bytes) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+
+// Finish the children that exited although their pipes are still open (processes
+// they left behind hold them)
+static void finish_exited(int n, int *fds, compare_t *cmps, feed_t *feeds, pid_t *pids, char *buffer,
+                          size_t size) {
+    for (int j = 0; j < n; j++) {
+        int out_fd = fds != NULL ? fds[j] : -1;
+        int in_fd = feeds != NULL ? feeds[j].fd : -1;
+        if ((out_fd == -1 && in_fd == -1) || !has_exited(pids[j]))
+            continue;
+
+        // Whoever still holds the input pipe isn't the child
+        if (feeds != NULL)
+            feed_stop(&feeds[j]);
+
+        // Everything the child wrote is in the pipe by now
+        if (out_fd != -1) {
+            if (drain_exited(out_fd, &cmps[j], buffer, size) == 0)
+                compare_finish(&cmps[j]);
+            close(out_fd);
+            fds[j] = -1;
+        }
+    }
+}
+
+
+void compare_drain(int n, int *fds, compare_t *cmps, feed_t *feeds, pid_t *pids,
+                   volatile long long *timed_out) {
+    // Output pipes in pfds[0..n-1], input pipes in pfds[n..2n-1]
+    struct pollfd *pfds = malloc(2 * n * sizeof(struct pollfd));
+    char buffer[65536];
+    long long checked_at = get_time_us();
+
+    while (!*timed_out) {
+        int open_fds = 0;
+        for (int j = 0; j < n; j++) {
+            pfds[j].fd = fds != NULL ? fds[j] : -1;     // poll() ignores negative fds
+            pfds[j].events = POLLIN;
+            pfds[n + j].fd = feeds != NULL ? feeds[j].fd : -1;
+            pfds[n + j].events = POLLOUT;
+            open_fds += (pfds[j].fd != -1) + (pfds[n + j].fd != -1);
+        }
+        if (open_fds == 0)
+            break;
+
+        // Wake up now and then to notice children whose descendants keep the pipe open,
+        // and look for them at least that often even while other pipes keep us busy
+        int ready = poll(pfds, 2 * n, COMPARE_EXIT_POLL_MS);
+        if (ready == -1) {
+            // Interrupted by the timeout handler -> loop condition decides
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(1);
+        }
+
+        for (int j = 0; ready > 0 && j < n; j++) {
+            // Room in the input pipe (or the child closed it -> EPIPE ends the feed)
+            if (pfds[n + j].fd != -1 && pfds[n + j].revents != 0)
+                feed_step(&feeds[j]);
+
+            if (pfds[j].fd == -1 || pfds[j].revents == 0)
+                continue;
+
+            ssize_t bytes = read(fds[j], buffer, sizeof(buffer));
+            if (bytes == -1 && errno == EINTR)
+                continue;
+
+            if (bytes > 0 && take_output(&cmps[j], buffer, bytes) == 0)
+                continue;
+
+            if (bytes > 0) {
+                // Mismatch -> the verdict is decided, stop the child (and its tree)
+                contain_kill(pids[j], j);
+                cmps[j].killed = 1;
+                if (feeds != NULL)
+                    feed_stop(&feeds[j]);
+            } else if (!cmps[j].mismatch) {
+                // End of output (or a read error, which is treated the same way)
+                compare_finish(&cmps[j]);
+            }
+            close(fds[j]);
+            fds[j] = -1;
+        }
+
+        if (ready == 0 || get_time_us() - checked_at >= COMPARE_EXIT_POLL_MS * 1000LL) {
+            finish_exited(n, fds, cmps, feeds, pids, buffer, sizeof(buffer));
+            checked_at = get_time_us();
+        }
+    }
+
+    // Timed out -> the children still holding pipes are being killed
+    for (int j = 0; j < n; j++) {
+        if (fds != NULL && fds[j] != -1) {
+            close(fds[j]);
+            fds[j] = -1;
+        }
+        if (feeds != NULL)
+            feed_stop(&feeds[j]);
+    }
+
+    free(pfds);
+}
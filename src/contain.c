@@ -0,0 +1,565 @@
+#include "utils.h"
+#include "contain.h"
+#include <sys/prctl.h>
+#include <ctype.h>
+
+// Most leaks listed individually at the end of the run
+#define CONTAIN_MAX_REPORTS 20
+
+// Cgroup paths are kept well below PATH_MAX so the files inside them always fit
+#define CGROUP_PATH_MAX (PATH_MAX - 64)
+
+contain_limits_t contain_limits;
+
+int contain_slots;                  // Number of slots set up by contain_init()
+pid_t contain_owner;                // Process that created the cgroups
+
+char contain_base[CGROUP_PATH_MAX];     // autograder.<pid> cgroup ("" when cgroups are unavailable)
+char (*contain_kill_paths)[PATH_MAX];   // <slot cgroup>/cgroup.kill of each slot
+
+int cg_memory;                      // memory.max is enforced by the slot cgroups
+int cg_pids;                        // pids.max is enforced by the slot cgroups
+long long *oom_kills_seen;          // memory.events oom_kill of each slot when last checked
+long long *pids_max_seen;           // pids.events max of each slot when last checked
+
+pid_t *killed_pids;                 // Leftovers killed by contain_release() (may still be exiting)
+int num_killed_pids;
+
+int leaked_total;                   // Leaked processes killed so far
+int leak_reports;                   // Entries in leak_report
+char leak_report[CONTAIN_MAX_REPORTS][128];
+
+
+// Find the cgroup v2 directory of this process, returns 0 on success
+static int own_cgroup_dir(char *dir, size_t size) {
+    // Mount point of the cgroup2 hierarchy (/sys/fs/cgroup, or .../unified on hybrid setups)
+    FILE *fp = fopen("/proc/self/mounts", "r");
+    if (fp == NULL)
+        return -1;
+
+    char line[1024], mount[PATH_MAX] = "";
+    while (fgets(line, sizeof(line), fp)) {
+        char dev[256], mnt[PATH_MAX], type[64];
+        if (sscanf(line, "%255s %4095s %63s", dev, mnt, type) == 3 && strcmp(type, "cgroup2") == 0) {
+            strcpy(mount, mnt);
+            break;
+        }
+    }
+    fclose(fp);
+    if (mount[0] == '\0')
+        return -1;
+
+    // Our place in it is the "0::<path>" line
+    fp = fopen("/proc/self/cgroup", "r");
+    if (fp == NULL)
+        return -1;
+
+    int found = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(dir, size, "%s%s", mount, strcmp(line + 3, "/") == 0 ? "" : line + 3);
+            found = 0;
+            break;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+
+// Kill a leftover process and remember it, so it isn't counted again while it exits
+static void kill_leftover(pid_t pid) {
+    kill(pid, SIGKILL);
+
+    if ((num_killed_pids & (num_killed_pids - 1)) == 0) {
+        // Grow at powers of two
+        killed_pids = realloc(killed_pids, 2 * (num_killed_pids + 1) * sizeof(pid_t));
+    }
+    killed_pids[num_killed_pids++] = pid;
+}
+
+
+static int already_killed(pid_t pid) {
+    for (int i = 0; i < num_killed_pids; i++) {
+        if (killed_pids[i] == pid)
+            return 1;
+    }
+    return 0;
+}
+
+
+// Read the state and process group of pid from /proc, returns 0 if it exists
+static int proc_stat(pid_t pid, char *state, pid_t *pgrp) {
+    char path[64], buffer[512];
+    sprintf(path, "/proc/%d/stat", pid);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    buffer[n] = '\0';
+
+    // The command name may contain spaces and parentheses -> parse after the last ')'
+    char *p = strrchr(buffer, ')');
+    int ppid, group;
+    if (p == NULL || sscanf(p + 1, " %c %d %d", state, &ppid, &group) != 3)
+        return -1;
+    *pgrp = group;
+    return 0;
+}
+
+
+// Kill every live (non-zombie) process in the process group pgrp, returns how many
+static int kill_group_members(pid_t pgrp) {
+    DIR *dir = opendir("/proc");
+    if (dir == NULL)
+        return 0;
+
+    int killed = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!isdigit((unsigned char) entry->d_name[0]))
+            continue;
+
+        pid_t pid = atoi(entry->d_name);
+        char state;
+        pid_t group;
+        if (proc_stat(pid, &state, &group) == 0 && group == pgrp && state != 'Z') {
+            kill_leftover(pid);
+            killed++;
+        }
+    }
+    closedir(dir);
+    return killed;
+}
+
+
+// Kill every live process listed in a cgroup.procs file outside the process group
+// skip_pgrp (those were handled already), returns how many
+static int kill_cgroup_members(const char *procs_path, pid_t skip_pgrp) {
+    FILE *fp = fopen(procs_path, "r");
+    if (fp == NULL)
+        return 0;
+
+    int killed = 0;
+    pid_t pid;
+    while (fscanf(fp, "%d", &pid) == 1) {
+        char state;
+        pid_t group;
+        if (proc_stat(pid, &state, &group) == 0 && state != 'Z' && group != skip_pgrp) {
+            kill_leftover(pid);
+            killed++;
+        }
+    }
+    fclose(fp);
+    return killed;
+}
+
+
+static void record_leak(int count, const char *exe, const char *param) {
+    leaked_total += count;
+    if (leak_reports < CONTAIN_MAX_REPORTS) {
+        snprintf(leak_report[leak_reports++], sizeof(leak_report[0]), "%s (param %s): %d",
+                 exe, param, count);
+    }
+}
+
+
+// Kill whatever is left in the slot cgroups and remove them
+static void remove_cgroups() {
+    // Only the grader itself, not a child that exit()s before exec()
+    if (contain_base[0] == '\0' || getpid() != contain_owner)
+        return;
+
+    for (int i = 0; i < contain_slots; i++) {
+        int fd = open(contain_kill_paths[i], O_WRONLY);
+        if (fd != -1) {
+            write(fd, "1", 1);
+            close(fd);
+        }
+    }
+
+    // Cgroups can only be removed once the killed processes are gone
+    for (int i = 0; i < contain_slots; i++) {
+        char slot_dir[PATH_MAX];
+        snprintf(slot_dir, sizeof(slot_dir), "%s/slot%d", contain_base, i);
+        for (int tries = 0; rmdir(slot_dir) == -1 && errno == EBUSY && tries < 100; tries++) {
+            usleep(10000);
+        }
+    }
+    rmdir(contain_base);
+    contain_base[0] = '\0';
+}
+
+
+void contain_limits_from_args(int *argc, char **argv) {
+    char *memory = take_option(argc, argv, "--mem-limit");
+    char *output = take_option(argc, argv, "--output-limit");
+    char *procs = take_option(argc, argv, "--proc-limit");
+
+    if (memory != NULL)
+        contain_limits.memory = parse_size("--mem-limit", memory);
+    if (output != NULL)
+        contain_limits.output = parse_size("--output-limit", output);
+    if (procs != NULL && (contain_limits.procs = atoi(procs)) <= 0) {
+        fprintf(stderr, "Bad process count '%s' for --proc-limit\n", procs);
+        exit(1);
+    }
+}
+
+
+// Write a value to a cgroup interface file, returns 0 on success
+static int cgroup_write(const char *dir, const char *file, const char *value) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+    int fd = open(path, O_WRONLY);
+    if (fd == -1)
+        return -1;
+    int ok = write(fd, value, strlen(value)) == (ssize_t) strlen(value);
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+
+// Value of "<key> <n>" in a flat-keyed cgroup file (memory.events, pids.events), 0 if missing
+static long long cgroup_counter(int slot, const char *file, const char *key) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/slot%d/%s", contain_base, slot, file);
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return 0;
+
+    char name[64];
+    long long value, found = 0;
+    while (fscanf(fp, "%63s %lld", name, &value) == 2) {
+        if (strcmp(name, key) == 0)
+            found = value;
+    }
+    fclose(fp);
+    return found;
+}
+
+
+// Enable the memory/pids controllers for the slots and set their limits. Needs the
+// controllers to be available in our own cgroup; otherwise the limits fall back to
+// rlimits in contain_enter().
+static void setup_cgroup_limits(const char *own) {
+    if (contain_limits.memory > 0) {
+        cgroup_write(own, "cgroup.subtree_control", "+memory");
+        cg_memory = cgroup_write(contain_base, "cgroup.subtree_control", "+memory") == 0;
+    }
+    if (contain_limits.procs > 0) {
+        cgroup_write(own, "cgroup.subtree_control", "+pids");
+        cg_pids = cgroup_write(contain_base, "cgroup.subtree_control", "+pids") == 0;
+    }
+
+    for (int i = 0; i < contain_slots; i++) {
+        char slot_dir[PATH_MAX], value[32];
+        snprintf(slot_dir, sizeof(slot_dir), "%s/slot%d", contain_base, i);
+
+        if (cg_memory) {
+            sprintf(value, "%lld", contain_limits.memory);
+            cgroup_write(slot_dir, "memory.max", value);
+            cgroup_write(slot_dir, "memory.swap.max", "0");     // Swapping out isn't a way around it
+        }
+        if (cg_pids) {
+            sprintf(value, "%d", contain_limits.procs);
+            cgroup_write(slot_dir, "pids.max", value);
+        }
+    }
+}
+
+
+// Number of processes owned by uid
+static int count_user_processes(uid_t uid) {
+    DIR *dir = opendir("/proc");
+    if (dir == NULL)
+        return 0;
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "/proc/%s", entry->d_name);
+        if (isdigit((unsigned char) entry->d_name[0]) && stat(path, &st) == 0 && st.st_uid == uid)
+            count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+
+// Limits enforced with rlimits in the child (whatever the cgroups don't cover)
+static void apply_rlimits() {
+    struct rlimit limit;
+
+    if (contain_limits.output > 0) {
+        limit.rlim_cur = limit.rlim_max = contain_limits.output;
+        setrlimit(RLIMIT_FSIZE, &limit);
+    }
+    if (contain_limits.memory > 0 && !cg_memory) {
+        limit.rlim_cur = limit.rlim_max = contain_limits.memory;
+        setrlimit(RLIMIT_AS, &limit);
+    }
+    if (contain_limits.procs > 0 && !cg_pids) {
+        // RLIMIT_NPROC counts every process of the user, not just this tree
+        // (and root ignores it), so leave room for the ones that already exist
+        limit.rlim_cur = limit.rlim_max = count_user_processes(getuid()) + contain_limits.procs - 1;
+        setrlimit(RLIMIT_NPROC, &limit);
+    }
+}
+
+
+void contain_init(int num_slots) {
+    contain_slots = num_slots;
+    contain_kill_paths = calloc(num_slots, sizeof(*contain_kill_paths));
+
+    // Orphaned descendants get re-parented to us instead of init
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+    char own[CGROUP_PATH_MAX];
+    if (own_cgroup_dir(own, sizeof(own)) == -1)
+        return;
+
+    int len = snprintf(contain_base, sizeof(contain_base), "%s/autograder.%d", own, getpid());
+    if (len >= (int) sizeof(contain_base) || mkdir(contain_base, 0755) == -1) {
+        // No delegated cgroup for us -> process groups only
+        contain_base[0] = '\0';
+        return;
+    }
+
+    // Don't leave the cgroups behind if the run exit()s early
+    contain_owner = getpid();
+    atexit(remove_cgroups);
+
+    for (int i = 0; i < num_slots; i++) {
+        char slot_dir[PATH_MAX];
+        snprintf(slot_dir, sizeof(slot_dir), "%s/slot%d", contain_base, i);
+        if (mkdir(slot_dir, 0755) == -1 && errno != EEXIST) {
+            perror("Failed to create slot cgroup");
+            exit(1);
+        }
+        snprintf(contain_kill_paths[i], PATH_MAX, "%s/slot%d/cgroup.kill", contain_base, i);
+    }
+
+    oom_kills_seen = calloc(num_slots, sizeof(long long));
+    pids_max_seen = calloc(num_slots, sizeof(long long));
+    setup_cgroup_limits(own);
+}
+
+
+void contain_enter(int slot) {
+    setpgid(0, 0);
+    apply_rlimits();
+
+    if (contain_base[0] == '\0')
+        return;
+
+    char procs_path[PATH_MAX];
+    snprintf(procs_path, sizeof(procs_path), "%s/slot%d/cgroup.procs", contain_base, slot);
+    int fd = open(procs_path, O_WRONLY);
+    if (fd == -1 || write(fd, "0", 1) == -1) {
+        perror("Failed to join slot cgroup");
+        exit(1);
+    }
+    close(fd);
+}
+
+
+void contain_adopt(pid_t pid) {
+    // Fails harmlessly if the child already exec'd (it has done it itself then)
+    setpgid(pid, pid);
+}
+
+
+void contain_kill(pid_t pid, int slot) {
+    // Already exited (just not reaped yet) -> leave its leftovers to contain_release(),
+    // which reports them as leaks instead of silently killing them here
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == pid)
+        return;
+
+    kill(-pid, SIGKILL);
+
+    if (contain_base[0] != '\0') {
+        int fd = open(contain_kill_paths[slot], O_WRONLY);
+        if (fd != -1) {
+            write(fd, "1", 1);
+            close(fd);
+        }
+    }
+}
+
+
+int contain_limit_status(int slot, int status, struct rusage *usage) {
+    // The event counters only ever grow -> compare with the last check of the slot
+    int oom_killed = 0, pids_maxed = 0;
+    if (cg_memory) {
+        long long oom_kills = cgroup_counter(slot, "memory.events", "oom_kill");
+        oom_killed = oom_kills > oom_kills_seen[slot];
+        oom_kills_seen[slot] = oom_kills;
+    }
+    if (cg_pids) {
+        long long pids_max = cgroup_counter(slot, "pids.events", "max");
+        pids_maxed = pids_max > pids_max_seen[slot];
+        pids_max_seen[slot] = pids_max;
+    }
+
+    int signal_number = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+
+    if (signal_number == SIGXFSZ)
+        return OUTPUT_LIMIT_EXCEEDED;
+    if (oom_killed)
+        return OUT_OF_MEMORY;
+
+    // Under RLIMIT_AS allocations just fail, which usually ends in a NULL dereference
+    // or abort() -> blame the limit if the child had actually used a good part of it
+    if (contain_limits.memory > 0 && !cg_memory
+        && (signal_number == SIGSEGV || signal_number == SIGABRT || signal_number == SIGBUS)
+        && usage->ru_maxrss * 1024LL >= contain_limits.memory / 2)
+        return OUT_OF_MEMORY;
+
+    if (pids_maxed)
+        return PROCESS_LIMIT_EXCEEDED;
+
+    return 0;
+}
+
+
+int contain_release(pid_t pid, int slot, int killed, const char *exe, const char *param) {
+    int leaked = 0;
+
+    // Anything still in the child's process group was started by it
+    if (kill(-pid, 0) == 0)
+        leaked += kill_group_members(pid);
+
+    // ... and anything still in its cgroup escaped the group
+    if (contain_base[0] != '\0') {
+        char procs_path[PATH_MAX];
+        snprintf(procs_path, sizeof(procs_path), "%s/slot%d/cgroup.procs", contain_base, slot);
+        leaked += kill_cgroup_members(procs_path, pid);
+    }
+
+    if (killed)
+        return 0;
+
+    if (leaked > 0)
+        record_leak(leaked, exe, param);
+
+    return leaked;
+}
+
+
+void contain_supervise() {
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+}
+
+
+void contain_bury(pid_t pid) {
+    // Its cgroups, with everything in them
+    char own[CGROUP_PATH_MAX], base[CGROUP_PATH_MAX];
+    if (own_cgroup_dir(own, sizeof(own)) == 0
+        && snprintf(base, sizeof(base), "%s/autograder.%d", own, pid) < (int) sizeof(base)) {
+        cgroup_write(base, "cgroup.kill", "1");
+
+        DIR *dir = opendir(base);
+        struct dirent *entry;
+        while (dir != NULL && (entry = readdir(dir)) != NULL) {
+            if (strncmp(entry->d_name, "slot", 4) != 0)
+                continue;
+            char slot_dir[PATH_MAX + NAME_MAX + 1];
+            snprintf(slot_dir, sizeof(slot_dir), "%s/%s", base, entry->d_name);
+            for (int tries = 0; rmdir(slot_dir) == -1 && errno == EBUSY && tries < 100; tries++) {
+                usleep(10000);
+            }
+        }
+        if (dir != NULL) {
+            closedir(dir);
+            rmdir(base);
+        }
+    }
+
+    // Its children (and theirs, once those are killed) are now ours
+    char children_path[64];
+    sprintf(children_path, "/proc/%d/task/%d/children", getpid(), getpid());
+    for (int round = 0; round < 16; round++) {
+        FILE *fp = fopen(children_path, "r");
+        if (fp == NULL)
+            break;
+
+        int found = 0;
+        pid_t child;
+        while (fscanf(fp, "%d", &child) == 1) {
+            char state;
+            pid_t group;
+            if (proc_stat(child, &state, &group) == -1 || group == getpgrp())
+                continue;
+            kill(-group, SIGKILL);
+            kill(child, SIGKILL);
+            waitpid(child, NULL, 0);
+            found++;
+        }
+        fclose(fp);
+
+        if (found == 0)
+            break;
+    }
+}
+
+
+void contain_finish() {
+    // Orphans re-parented to us that are still around (or zombies to reap). Killing
+    // one re-parents its own children to us, so go again until there are none.
+    char children_path[64];
+    sprintf(children_path, "/proc/%d/task/%d/children", getpid(), getpid());
+    int orphans = 0;
+    for (int round = 0; round < 16; round++) {
+        FILE *fp = fopen(children_path, "r");
+        if (fp == NULL)
+            break;
+
+        int found = 0;
+        pid_t pid;
+        while (fscanf(fp, "%d", &pid) == 1) {
+            char state;
+            pid_t group;
+            if (proc_stat(pid, &state, &group) == 0 && state != 'Z') {
+                kill(pid, SIGKILL);
+                if (!already_killed(pid))
+                    orphans++;
+            }
+            waitpid(pid, NULL, 0);
+            found++;
+        }
+        fclose(fp);
+
+        if (found == 0)
+            break;
+    }
+    if (orphans > 0)
+        record_leak(orphans, "(orphaned)", "-");
+
+    if (leaked_total > 0) {
+        fprintf(stderr, "Killed %d leaked descendant process(es) of submissions:\n", leaked_total);
+        for (int i = 0; i < leak_reports; i++) {
+            fprintf(stderr, "    %s\n", leak_report[i]);
+        }
+        if (leak_reports == CONTAIN_MAX_REPORTS)
+            fprintf(stderr, "    ...\n");
+    }
+
+    remove_cgroups();
+
+    free(contain_kill_paths);
+    free(killed_pids);
+    free(oom_kills_seen);
+    free(pids_max_seen);
+}
@@ -0,0 +1,698 @@
+#include "utils.h"
+#include "delta.h"
+
+// Status of cells that were never tested
+#define UNKNOWN "unknown"
+
+// One line of a delta file
+typedef struct {
+    char **columns;         // {"columns":[...]}, NULL otherwise
+    int num_columns;
+    char *exe;              // {"exe":...}, NULL otherwise
+    char **labels;          // ... its "cells"
+    char **statuses;
+    int num_cells;
+    char *score;            // ... its "score", NULL if none
+    int removed;            // ... "removed":true
+    int end;                // {"end":true}
+} delta_op_t;
+
+
+static char *copy_trimmed(const char *s, int len) {
+    while (len > 0 && s[len - 1] == ' ') {
+        len--;
+    }
+    char *copy = malloc(len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+
+static void free_strings(char **strings, int n) {
+    for (int i = 0; i < n && strings != NULL; i++) {
+        free(strings[i]);
+    }
+    free(strings);
+}
+
+
+static void free_row(delta_row_t *row, int num_columns) {
+    free(row->name);
+    free_strings(row->cells, num_columns);
+    free(row->score);
+}
+
+
+static int compare_rows(const void *a, const void *b) {
+    return strcmp(((const delta_row_t *) a)->name, ((const delta_row_t *) b)->name);
+}
+
+
+// Row of name (rows are kept sorted by name), or NULL with *at set to where it would go
+static delta_row_t *find_row(delta_table_t *table, const char *name, int *at) {
+    int lo = 0, hi = table->num_rows;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(table->rows[mid].name, name);
+        if (cmp == 0)
+            return &table->rows[mid];
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (at != NULL)
+        *at = lo;
+    return NULL;
+}
+
+
+// Insert a row of unknown cells for name at position at
+static delta_row_t *insert_row(delta_table_t *table, const char *name, int at) {
+    table->rows = realloc(table->rows, (table->num_rows + 1) * sizeof(delta_row_t));
+    memmove(&table->rows[at + 1], &table->rows[at], (table->num_rows - at) * sizeof(delta_row_t));
+    table->num_rows++;
+
+    delta_row_t *row = &table->rows[at];
+    row->name = strdup(name);
+    row->cells = malloc(table->num_columns * sizeof(char *));
+    for (int c = 0; c < table->num_columns; c++) {
+        row->cells[c] = strdup(UNKNOWN);
+    }
+    row->score = NULL;
+    return row;
+}
+
+
+// Parse one results.txt row into table (the first one also sets the columns)
+static int parse_results_row(delta_table_t *table, char *line, int first) {
+    line[strcspn(line, "\n")] = '\0';
+    if (*line == '\0')
+        return 0;
+
+    // The name ends at the last ':' before the first cell, labels have no ':'
+    char *paren = strchr(line, '('), *sep = NULL;
+    for (char *c = line; *c != '\0' && (paren == NULL || c < paren); c++) {
+        if (*c == ':')
+            sep = c;
+    }
+    if (sep == NULL)
+        return -1;
+
+    int capacity = first ? 16 : table->num_columns;
+    char **cells = malloc((capacity + 1) * sizeof(char *));
+    int num_cells = 0;
+    for (char *s = sep + 1; *(s += strspn(s, " ")) != '\0'; ) {
+        char *label = s;
+        int label_len = strcspn(s, " (");
+        s += label_len;
+        s += strspn(s, " ");
+        if (*s != '(')
+            break;
+        s += 1 + strspn(s + 1, " ");
+        char *status = s;
+        int status_len = strcspn(s, ")");
+        s += status_len;
+        if (*s != ')')
+            break;
+        s++;
+
+        if (first) {
+            if (num_cells == capacity) {
+                capacity *= 2;
+                cells = realloc(cells, (capacity + 1) * sizeof(char *));
+            }
+            table->columns = realloc(table->columns, (num_cells + 1) * sizeof(char *));
+            table->columns[num_cells] = copy_trimmed(label, label_len);
+            table->num_columns++;
+        } else if (num_cells == table->num_columns || (int) strlen(table->columns[num_cells]) != label_len
+                   || strncmp(table->columns[num_cells], label, label_len) != 0) {
+            break;
+        }
+        cells[num_cells++] = copy_trimmed(status, status_len);
+    }
+    if (num_cells != table->num_columns) {
+        free_strings(cells, num_cells);
+        return -1;
+    }
+
+    table->rows = realloc(table->rows, (table->num_rows + 1) * sizeof(delta_row_t));
+    delta_row_t *row = &table->rows[table->num_rows++];
+    row->name = copy_trimmed(line, sep - line);
+    row->cells = cells;
+    row->score = NULL;
+    return 0;
+}
+
+
+int delta_table_read(delta_table_t *table, const char *results_path, const char *scores_path) {
+    memset(table, 0, sizeof(delta_table_t));
+
+    char *line = NULL;
+    size_t cap = 0;
+    int ret = 0;
+    FILE *fp = fopen(results_path, "r");
+    if (fp != NULL) {
+        while (ret == 0 && getline(&line, &cap, fp) != -1) {
+            ret = parse_results_row(table, line, table->num_rows == 0 && table->num_columns == 0);
+        }
+        fclose(fp);
+    }
+    qsort(table->rows, table->num_rows, sizeof(delta_row_t), compare_rows);
+
+    // "<name padded>: <score>"; lines of executables results.txt doesn't have are ignored
+    fp = ret == 0 ? fopen(scores_path, "r") : NULL;
+    if (fp != NULL) {
+        while (getline(&line, &cap, fp) != -1) {
+            line[strcspn(line, "\n")] = '\0';
+            char *sep = strrchr(line, ':');
+            if (sep == NULL)
+                continue;
+            *sep = '\0';
+            char *name = copy_trimmed(line, sep - line);
+            delta_row_t *row = find_row(table, name, NULL);
+            if (row != NULL) {
+                char *score = sep + 1 + strspn(sep + 1, " ");
+                free(row->score);
+                row->score = copy_trimmed(score, strlen(score));
+            }
+            free(name);
+        }
+        fclose(fp);
+    }
+    free(line);
+    return ret;
+}
+
+
+// Sort order of results.txt: by the number after the last '_' (see write_results_to_file())
+static int compare_numbered(const void *a, const void *b, void *rows) {
+    const char *name_a = ((delta_row_t *) rows)[*(const int *) a].name;
+    const char *name_b = ((delta_row_t *) rows)[*(const int *) b].name;
+    const char *num_a = strrchr(name_a, '_'), *num_b = strrchr(name_b, '_');
+    int na = num_a != NULL ? atoi(num_a + 1) : 0, nb = num_b != NULL ? atoi(num_b + 1) : 0;
+    if (na != nb)
+        return na < nb ? -1 : 1;
+    return strcmp(name_a, name_b);
+}
+
+
+// Write to path through path.tmp, so readers never see a partial file
+static FILE *open_replacement(const char *path, char *tmp_path) {
+    snprintf(tmp_path, PATH_MAX, "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (fp == NULL)
+        perror(tmp_path);
+    return fp;
+}
+
+
+static void close_replacement(FILE *fp, const char *tmp_path, const char *path) {
+    if (fclose(fp) != 0 || rename(tmp_path, path) == -1) {
+        perror(path);
+        unlink(tmp_path);
+    }
+}
+
+
+void delta_table_write(delta_table_t *table, const char *results_path, const char *scores_path) {
+    int longest_len = 0;
+    int *order = malloc((table->num_rows + 1) * sizeof(int));
+    for (int r = 0; r < table->num_rows; r++) {
+        int len = strlen(table->rows[r].name);
+        if (len > longest_len)
+            longest_len = len;
+        order[r] = r;
+    }
+    qsort_r(order, table->num_rows, sizeof(int), compare_numbered, table->rows);
+
+    char tmp_path[PATH_MAX];
+    FILE *fp = open_replacement(results_path, tmp_path);
+    if (fp != NULL) {
+        for (int k = 0; k < table->num_rows; k++) {
+            delta_row_t *row = &table->rows[order[k]];
+            fprintf(fp, "%-*s:", longest_len, row->name);
+            for (int c = 0; c < table->num_columns; c++) {
+                fprintf(fp, "%5s (%9s) ", table->columns[c], row->cells[c]);
+            }
+            fprintf(fp, "\n");
+        }
+        close_replacement(fp, tmp_path, results_path);
+    }
+
+    fp = open_replacement(scores_path, tmp_path);
+    if (fp != NULL) {
+        for (int k = 0; k < table->num_rows; k++) {
+            delta_row_t *row = &table->rows[order[k]];
+            if (row->score != NULL) {
+                fprintf(fp, "%-*s: %5s\n", longest_len, row->name, row->score);
+                continue;
+            }
+
+            // Same as get_score(): the fraction of all cells that are correct
+            int correct = 0;
+            for (int c = 0; c < table->num_columns; c++) {
+                correct += strcmp(row->cells[c], "correct") == 0;
+            }
+            fprintf(fp, "%-*s: %5.3f\n", longest_len, row->name,
+                    table->num_columns > 0 ? (double) correct / table->num_columns : 0.0);
+        }
+        close_replacement(fp, tmp_path, scores_path);
+    }
+    free(order);
+}
+
+
+void delta_table_free(delta_table_t *table) {
+    for (int r = 0; r < table->num_rows; r++) {
+        free_row(&table->rows[r], table->num_columns);
+    }
+    free(table->rows);
+    free_strings(table->columns, table->num_columns);
+    memset(table, 0, sizeof(delta_table_t));
+}
+
+
+FILE *delta_open(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    return fp;
+}
+
+
+delta_t *delta_begin(const char *results_path, const char *scores_path) {
+    delta_t *delta = malloc(sizeof(delta_t));
+    delta->results_path = results_path;
+    delta->scores_path = scores_path;
+    if (delta_table_read(&delta->base, results_path, scores_path) == -1) {
+        fprintf(stderr, "%s isn't in the results format, the delta lists every row\n", results_path);
+        delta_table_free(&delta->base);
+    }
+    return delta;
+}
+
+
+// Write s to out as a JSON string
+static void json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+
+// Index of column label in columns (index: sort_columns()), -1 if missing
+static int find_column(char **columns, const int *index, int num_columns, const char *label) {
+    int lo = 0, hi = num_columns;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(columns[index[mid]], label);
+        if (cmp == 0)
+            return index[mid];
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+
+static int compare_labels(const void *a, const void *b, void *columns) {
+    return strcmp(((char **) columns)[*(const int *) a], ((char **) columns)[*(const int *) b]);
+}
+
+
+// Indices of columns sorted by label, for find_column()
+static int *sort_columns(char **columns, int num_columns) {
+    int *index = malloc((num_columns + 1) * sizeof(int));
+    for (int c = 0; c < num_columns; c++) {
+        index[c] = c;
+    }
+    qsort_r(index, num_columns, sizeof(int), compare_labels, columns);
+    return index;
+}
+
+
+// Column of from that has each label of to, -1 for new ones
+static int *map_columns(char **from, int num_from, char **to, int num_to) {
+    int *map = malloc((num_to + 1) * sizeof(int));
+    int same = num_from == num_to;
+    for (int c = 0; same && c < num_to; c++) {
+        same = strcmp(from[c], to[c]) == 0;
+    }
+    if (same) {
+        for (int c = 0; c < num_to; c++) {
+            map[c] = c;
+        }
+        return map;
+    }
+
+    int *index = sort_columns(from, num_from);
+    for (int c = 0; c < num_to; c++) {
+        map[c] = find_column(from, index, num_from, to[c]);
+    }
+    free(index);
+    return map;
+}
+
+
+// Status column c of a row had in old (NULL for a new row), through map
+static const char *cell_before(delta_row_t *old, const int *map, int c) {
+    return old != NULL && map[c] != -1 ? old->cells[map[c]] : UNKNOWN;
+}
+
+
+int delta_end(delta_t *delta, FILE *out) {
+    delta_table_t *base = &delta->base, current;
+    if (delta_table_read(&current, delta->results_path, delta->scores_path) == -1)
+        delta_table_free(&current);
+
+    int *map = map_columns(base->columns, base->num_columns, current.columns, current.num_columns);
+    int columns_changed = base->num_columns != current.num_columns;
+    for (int c = 0; !columns_changed && c < current.num_columns; c++) {
+        columns_changed = map[c] != c;
+    }
+    if (columns_changed) {
+        fprintf(out, "{\"columns\":[");
+        for (int c = 0; c < current.num_columns; c++) {
+            if (c > 0)
+                fputc(',', out);
+            json_string(out, current.columns[c]);
+        }
+        fprintf(out, "]}\n");
+    }
+
+    // Both tables are sorted by name
+    int changed = 0;
+    for (int r = 0, b = 0; r < current.num_rows || b < base->num_rows; ) {
+        int cmp = r == current.num_rows ? 1 : b == base->num_rows ? -1
+                  : strcmp(current.rows[r].name, base->rows[b].name);
+        if (cmp > 0) {
+            fprintf(out, "{\"exe\":");
+            json_string(out, base->rows[b++].name);
+            fprintf(out, ",\"removed\":true}\n");
+            changed++;
+            continue;
+        }
+
+        delta_row_t *row = &current.rows[r++];
+        delta_row_t *old = cmp == 0 ? &base->rows[b++] : NULL;
+
+        // A new row lists all its known cells, as they were all unknown
+        int cells_changed = 0;
+        for (int c = 0; c < current.num_columns && !cells_changed; c++) {
+            cells_changed = strcmp(row->cells[c], cell_before(old, map, c)) != 0;
+        }
+        int score_changed = row->score != NULL
+                            && (old == NULL || old->score == NULL || strcmp(row->score, old->score) != 0);
+        if (old != NULL && !cells_changed && !score_changed)
+            continue;
+        changed++;
+
+        fprintf(out, "{\"exe\":");
+        json_string(out, row->name);
+        if (cells_changed || old == NULL) {
+            fprintf(out, ",\"cells\":{");
+            for (int c = 0, cells = 0; c < current.num_columns; c++) {
+                if (strcmp(row->cells[c], cell_before(old, map, c)) == 0)
+                    continue;
+                if (cells++ > 0)
+                    fputc(',', out);
+                json_string(out, current.columns[c]);
+                fputc(':', out);
+                json_string(out, row->cells[c]);
+            }
+            fputc('}', out);
+        }
+        if (score_changed) {
+            fprintf(out, ",\"score\":");
+            json_string(out, row->score);
+        }
+        fprintf(out, "}\n");
+    }
+    fprintf(out, "{\"end\":true}\n");
+    fflush(out);
+
+    free(map);
+    delta_table_free(&current);
+    delta_table_free(base);
+    free(delta);
+    return changed;
+}
+
+
+// Cursor of the delta line being parsed
+typedef struct {
+    const char *s;
+    int bad;
+} json_t;
+
+
+// Skip whitespace and take c, returns 0 (and marks the line bad) if it isn't there
+static int json_take(json_t *json, char c) {
+    json->s += strspn(json->s, " \t\r\n");
+    if (*json->s != c) {
+        json->bad = 1;
+        return 0;
+    }
+    json->s++;
+    return 1;
+}
+
+
+// Whether the next thing is c (without taking it)
+static int json_peek(json_t *json, char c) {
+    json->s += strspn(json->s, " \t\r\n");
+    return *json->s == c;
+}
+
+
+// A JSON string as written by json_string(), NULL if malformed
+static char *json_parse_string(json_t *json) {
+    if (!json_take(json, '"'))
+        return NULL;
+
+    char *str = malloc(strlen(json->s) + 1);
+    int n = 0;
+    for (; *json->s != '"'; json->s++) {
+        char c = *json->s;
+        if (c == '\0')
+            break;
+        if (c == '\\') {
+            c = *++json->s;
+            unsigned code;
+            if (c == 'u' && sscanf(json->s + 1, "%4x", &code) == 1 && code < 0x80) {
+                c = code;
+                json->s += 4;
+            } else if (c == 'n') {
+                c = '\n';
+            } else if (c == 't') {
+                c = '\t';
+            } else if (c != '"' && c != '\\' && c != '/') {
+                break;
+            }
+        }
+        str[n++] = c;
+    }
+    if (*json->s != '"') {
+        json->bad = 1;
+        free(str);
+        return NULL;
+    }
+    json->s++;
+    str[n] = '\0';
+    return str;
+}
+
+
+static void free_op(delta_op_t *op) {
+    free_strings(op->columns, op->num_columns);
+    free(op->exe);
+    free_strings(op->labels, op->num_cells);
+    free_strings(op->statuses, op->num_cells);
+    free(op->score);
+}
+
+
+// Parse one line of a delta file (see delta.h) into op, returns -1 if malformed
+static int parse_op(delta_op_t *op, const char *line) {
+    memset(op, 0, sizeof(delta_op_t));
+    json_t json = { line, 0 };
+    json_take(&json, '{');
+    while (!json.bad) {
+        char *key = json_parse_string(&json);
+        if (key == NULL || !json_take(&json, ':')) {
+            free(key);
+            break;
+        }
+
+        if (strcmp(key, "columns") == 0 && op->columns == NULL) {
+            op->columns = malloc(sizeof(char *));
+            json_take(&json, '[');
+            while (!json.bad && !json_peek(&json, ']')) {
+                if (op->num_columns > 0)
+                    json_take(&json, ',');
+                char *label = json_parse_string(&json);
+                if (label == NULL)
+                    break;
+                op->columns = realloc(op->columns, (op->num_columns + 1) * sizeof(char *));
+                op->columns[op->num_columns++] = label;
+            }
+            json_take(&json, ']');
+        } else if (strcmp(key, "exe") == 0 && op->exe == NULL) {
+            op->exe = json_parse_string(&json);
+        } else if (strcmp(key, "cells") == 0 && op->labels == NULL) {
+            op->labels = malloc(sizeof(char *));
+            op->statuses = malloc(sizeof(char *));
+            json_take(&json, '{');
+            while (!json.bad && !json_peek(&json, '}')) {
+                if (op->num_cells > 0)
+                    json_take(&json, ',');
+                char *label = json_parse_string(&json);
+                char *status = json_take(&json, ':') ? json_parse_string(&json) : NULL;
+                if (status == NULL) {
+                    free(label);
+                    break;
+                }
+                op->labels = realloc(op->labels, (op->num_cells + 1) * sizeof(char *));
+                op->statuses = realloc(op->statuses, (op->num_cells + 1) * sizeof(char *));
+                op->labels[op->num_cells] = label;
+                op->statuses[op->num_cells++] = status;
+            }
+            json_take(&json, '}');
+        } else if (strcmp(key, "score") == 0 && op->score == NULL) {
+            op->score = json_parse_string(&json);
+        } else if ((strcmp(key, "removed") == 0 || strcmp(key, "end") == 0)
+                   && strncmp(json.s += strspn(json.s, " \t"), "true", 4) == 0) {
+            json.s += 4;
+            *(key[0] == 'r' ? &op->removed : &op->end) = 1;
+        } else {
+            json.bad = 1;
+        }
+        free(key);
+
+        if (json_peek(&json, '}'))
+            break;
+        json_take(&json, ',');
+    }
+    json_take(&json, '}');
+    json.s += strspn(json.s, " \t\r\n");
+
+    // Exactly one kind of line
+    if (json.bad || *json.s != '\0' || (op->columns != NULL) + (op->exe != NULL) + op->end != 1
+        || (op->exe == NULL && (op->labels != NULL || op->score != NULL || op->removed))) {
+        free_op(op);
+        return -1;
+    }
+    return 0;
+}
+
+
+// Apply one parsed line to table; *index is the column index (see sort_columns())
+static void apply_op(delta_table_t *table, delta_op_t *op, int **index) {
+    if (op->end)
+        return;
+    if (op->columns != NULL) {
+        // Cells of the columns that stay keep their status, new ones are unknown
+        int *map = map_columns(table->columns, table->num_columns, op->columns, op->num_columns);
+        for (int r = 0; r < table->num_rows; r++) {
+            char **cells = malloc((op->num_columns + 1) * sizeof(char *));
+            for (int c = 0; c < op->num_columns; c++) {
+                cells[c] = strdup(cell_before(&table->rows[r], map, c));
+            }
+            free_strings(table->rows[r].cells, table->num_columns);
+            table->rows[r].cells = cells;
+        }
+        free(map);
+        free_strings(table->columns, table->num_columns);
+        table->columns = op->columns;
+        table->num_columns = op->num_columns;
+        op->columns = NULL;
+        op->num_columns = 0;
+        free(*index);
+        *index = sort_columns(table->columns, table->num_columns);
+        return;
+    }
+
+    int at;
+    delta_row_t *row = find_row(table, op->exe, &at);
+    if (op->removed) {
+        if (row != NULL) {
+            free_row(row, table->num_columns);
+            at = row - table->rows;
+            memmove(row, row + 1, (table->num_rows - at - 1) * sizeof(delta_row_t));
+            table->num_rows--;
+        }
+        return;
+    }
+
+    if (row == NULL)
+        row = insert_row(table, op->exe, at);
+    for (int k = 0; k < op->num_cells; k++) {
+        int c = find_column(table->columns, *index, table->num_columns, op->labels[k]);
+        if (c == -1)
+            continue;
+        free(row->cells[c]);
+        row->cells[c] = op->statuses[k];
+        op->statuses[k] = NULL;
+    }
+    if (op->score != NULL) {
+        free(row->score);
+        row->score = op->score;
+        op->score = NULL;
+    }
+}
+
+
+int delta_patch(delta_table_t *table, FILE *in) {
+    // A block is only applied once its end line has been read
+    delta_op_t *block = NULL;
+    int block_len = 0, blocks = 0, ret = 0;
+    int *index = sort_columns(table->columns, table->num_columns);
+
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, in) != -1) {
+        if (line[strspn(line, " \t\r\n")] == '\0')
+            continue;
+
+        block = realloc(block, (block_len + 1) * sizeof(delta_op_t));
+        if (parse_op(&block[block_len], line) == -1) {
+            ret = -1;
+            break;
+        }
+        if (!block[block_len++].end)
+            continue;
+
+        for (int k = 0; k < block_len; k++) {
+            apply_op(table, &block[k], &index);
+            free_op(&block[k]);
+        }
+        block_len = 0;
+        blocks++;
+    }
+
+    for (int k = 0; k < block_len; k++) {
+        free_op(&block[k]);
+    }
+    free(block);
+    free(line);
+    free(index);
+    return ret == -1 ? -1 : blocks;
+}
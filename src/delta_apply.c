@@ -0,0 +1,38 @@
+#include "utils.h"
+#include "delta.h"
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 4) {
+        printf("Usage: %s <delta> [<results.txt> [<scores.txt>]]\n", argv[0]);
+        return 1;
+    }
+    char *results_file = argc > 2 ? argv[2] : results_path;
+    char *scores_file = argc > 3 ? argv[3] : scores_path;
+
+    FILE *in = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+    if (in == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    delta_table_t table;
+    if (delta_table_read(&table, results_file, scores_file) == -1) {
+        fprintf(stderr, "%s isn't in the results format\n", results_file);
+        return 1;
+    }
+
+    int blocks = delta_patch(&table, in);
+    if (blocks == -1) {
+        fprintf(stderr, "Malformed delta %s, nothing applied\n", argv[1]);
+        return 1;
+    }
+    if (blocks > 0)
+        delta_table_write(&table, results_file, scores_file);
+    printf("%d blocks applied, %d rows\n", blocks, table.num_rows);
+
+    if (in != stdin)
+        fclose(in);
+    delta_table_free(&table);
+    return 0;
+}
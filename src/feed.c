@@ -0,0 +1,93 @@
+#include "utils.h"
+#include "feed.h"
+#include <sys/uio.h>
+
+// Bytes moved by one pread()/write() when splicing isn't available
+#define FEED_COPY_CHUNK 65536
+
+
+void feed_pipe(int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("couldn't create pipes");
+        exit(1);
+    }
+
+    // The child gets the read end across exec(), but no child may inherit another
+    // one's write end, or that child would never see EOF
+    fcntl(fds[0], F_SETFD, 0);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETPIPE_SZ, FEED_PIPE_SIZE);
+}
+
+
+void feed_start(feed_t *feed, int fd, int src_fd, const char *buf, long long len) {
+    feed->fd = fd;
+    feed->src_fd = src_fd;
+    feed->buf = buf;
+    feed->len = len;
+    feed->off = 0;
+    feed->copy = 0;
+
+    // Nothing to wait for if it all fits in the pipe right away
+    feed_step(feed);
+}
+
+
+// Move the next bytes into the pipe, returns what write() would
+static ssize_t feed_some(feed_t *feed) {
+    size_t want = feed->len - feed->off;
+
+    if (feed->copy) {
+        static char buffer[FEED_COPY_CHUNK];
+        if (feed->src_fd == -1)
+            return write(feed->fd, feed->buf + feed->off, want);
+
+        // Nothing is lost if the write comes up short - the next pread() starts at off
+        ssize_t n = pread(feed->src_fd, buffer, want < sizeof(buffer) ? want : sizeof(buffer), feed->off);
+        if (n <= 0)
+            return n;
+        return write(feed->fd, buffer, n);
+    }
+
+    if (feed->src_fd != -1) {
+        loff_t off = feed->off;
+        return splice(feed->src_fd, &off, feed->fd, NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+
+    struct iovec iov = { (void *) (feed->buf + feed->off), want };
+    return vmsplice(feed->fd, &iov, 1, SPLICE_F_NONBLOCK);
+}
+
+
+int feed_step(feed_t *feed) {
+    while (feed->fd != -1 && feed->off < feed->len) {
+        ssize_t n = feed_some(feed);
+
+        if (n > 0) {
+            feed->off += n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && errno == EAGAIN) {
+            // Pipe is full -> wait until the child has read some
+            return 1;
+        } else if (n == -1 && (errno == EINVAL || errno == ENOSYS) && !feed->copy) {
+            // Source or pipe can't be spliced -> copy instead
+            feed->copy = 1;
+        } else {
+            // EPIPE: the child is gone or closed its input early, which is its business.
+            // n == 0: the input file is shorter than it was when the feed started.
+            break;
+        }
+    }
+
+    feed_stop(feed);
+    return 0;
+}
+
+
+void feed_stop(feed_t *feed) {
+    if (feed->fd != -1) {
+        close(feed->fd);    // EOF for the child
+        feed->fd = -1;
+    }
+}
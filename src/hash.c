@@ -0,0 +1,111 @@
+#include "utils.h"
+#include "hash.h"
+
+
+unsigned long long hash_string(unsigned long long hash, const char *s) {
+    for (; *s != '\0'; s++) {
+        hash = (hash ^ (unsigned char) *s) * FNV_PRIME;
+    }
+    return hash;
+}
+
+
+unsigned long long mix64(unsigned long long x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+static char **keys_of(hash_table_t *table, long i) {
+    return (char **) (table->slots + i * table->slot_size);
+}
+
+
+// Slot index of (key, key2), or of the empty slot where it would go
+static long probe(hash_table_t *table, const char *key, const char *key2) {
+    unsigned long long hash = hash_string(FNV_OFFSET, key);
+    if (table->num_keys == 2) {
+        hash = (hash ^ 0) * FNV_PRIME;     // Separator, so ("a", "bc") != ("ab", "c")
+        hash = hash_string(hash, key2);
+    }
+
+    long i = hash & (table->capacity - 1);
+    for (char **keys = keys_of(table, i); keys[0] != NULL; keys = keys_of(table, i)) {
+        if (strcmp(keys[0], key) == 0 && (table->num_keys == 1 || strcmp(keys[1], key2) == 0))
+            break;
+        i = (i + 1) & (table->capacity - 1);
+    }
+    return i;
+}
+
+
+void hash_table_init(hash_table_t *table, size_t slot_size, int num_keys, long capacity) {
+    table->slots = calloc(capacity, slot_size);
+    table->slot_size = slot_size;
+    table->num_keys = num_keys;
+    table->capacity = capacity;
+    table->count = 0;
+}
+
+
+static void grow(hash_table_t *table) {
+    char *old = table->slots;
+    long old_capacity = table->capacity;
+
+    table->capacity = 2 * old_capacity;
+    table->slots = calloc(table->capacity, table->slot_size);
+    for (long i = 0; i < old_capacity; i++) {
+        char **keys = (char **) (old + i * table->slot_size);
+        if (keys[0] != NULL) {
+            long j = probe(table, keys[0], table->num_keys == 2 ? keys[1] : NULL);
+            memcpy(keys_of(table, j), keys, table->slot_size);
+        }
+    }
+    free(old);
+}
+
+
+void *hash_table_find(hash_table_t *table, const char *key, const char *key2) {
+    if (table->count == 0)
+        return NULL;
+    char **keys = keys_of(table, probe(table, key, key2));
+    return keys[0] != NULL ? keys : NULL;
+}
+
+
+void *hash_table_insert(hash_table_t *table, const char *key, const char *key2) {
+    // Keep the table at most half full
+    if (2 * (table->count + 1) > table->capacity)
+        grow(table);
+
+    char **keys = keys_of(table, probe(table, key, key2));
+    if (keys[0] == NULL) {
+        keys[0] = strdup(key);
+        if (table->num_keys == 2)
+            keys[1] = strdup(key2);
+        table->count++;
+    }
+    return keys;
+}
+
+
+void *hash_table_slot(hash_table_t *table, long i) {
+    char **keys = keys_of(table, i);
+    return keys[0] != NULL ? keys : NULL;
+}
+
+
+void hash_table_free(hash_table_t *table) {
+    for (long i = 0; i < table->capacity; i++) {
+        char **keys = keys_of(table, i);
+        free(keys[0]);
+        if (table->num_keys == 2)
+            free(keys[1]);
+    }
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
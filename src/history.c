@@ -0,0 +1,164 @@
+#include "utils.h"
+#include "history.h"
+
+// Average of an executable's loaded entries, the fallback for pairs the history doesn't
+// have. Pairs that timed out are counted apart, since they take whatever the timeout is.
+typedef struct {
+    char *exe;                  // Key (see hash.h)
+    long long sum_us;           // Run times of the pairs that didn't time out
+    long stuck;                 // Pairs that timed out
+    long count;
+} exe_average_t;
+
+
+// Run time a pair with this outcome is expected to take next time
+static long long expected_us(history_t *history, int status, long long duration_us) {
+    return status == STUCK_OR_INFINITE ? history->stuck_us : duration_us;
+}
+
+
+static void add_to_averages(history_t *history, const char *exe, int status, long long duration_us) {
+    exe_average_t *average = hash_table_insert(&history->averages, exe, NULL);
+    int stuck = status == STUCK_OR_INFINITE;
+    average->sum_us += stuck ? 0 : duration_us;
+    average->stuck += stuck;
+    average->count++;
+
+    history->total_sum_us += stuck ? 0 : duration_us;
+    history->total_stuck += stuck;
+    history->total_count++;
+}
+
+
+history_t *history_load(const char *path) {
+    history_t *history = calloc(1, sizeof(history_t));
+    hash_table_init(&history->entries, sizeof(history_entry_t), 2, 1024);
+    hash_table_init(&history->averages, sizeof(exe_average_t), 1, 256);
+    history->stuck_us = HISTORY_STUCK_US;
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        if (errno != ENOENT) {
+            perror(path);
+            exit(1);
+        }
+        return history;     // First run -> no history yet
+    }
+
+    char exe[NAME_MAX + 1], label[PARAM_LABEL_MAX + 1];
+    int status;
+    long long duration_us;
+    long rss_kb;
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, fp) != -1) {
+        // The peak RSS is missing from files written before it was recorded
+        rss_kb = 0;
+        int fields = sscanf(line, "%255s %16s %d %lld %ld", exe, label, &status, &duration_us, &rss_kb);
+        if (fields == EOF)
+            continue;
+        if (fields < 4 || rss_kb < 0) {
+            fprintf(stderr, "Malformed history file %s (after %ld entries)\n", path, history->entries.count);
+            exit(1);
+        }
+        history_record(history, exe, label, status, duration_us, rss_kb);
+        add_to_averages(history, exe, status, duration_us);
+    }
+    free(line);
+    fclose(fp);
+
+    history->loaded = history->entries.count;
+    return history;
+}
+
+
+long long history_predict(history_t *history, const char *exe, const char *label) {
+    history_entry_t *entry = hash_table_find(&history->entries, exe, label);
+    if (entry != NULL)
+        return expected_us(history, entry->status, entry->duration_us);
+
+    exe_average_t *average = hash_table_find(&history->averages, exe, NULL);
+    if (average != NULL)
+        return (average->sum_us + average->stuck * history->stuck_us) / average->count;
+
+    if (history->total_count == 0)
+        return 0;
+    return (history->total_sum_us + history->total_stuck * history->stuck_us) / history->total_count;
+}
+
+
+history_entry_t *history_lookup(history_t *history, const char *exe, const char *label) {
+    return hash_table_find(&history->entries, exe, label);
+}
+
+
+void history_record(history_t *history, const char *exe, const char *label, int status, long long duration_us,
+                    long rss_kb) {
+    history_entry_t *entry = hash_table_insert(&history->entries, exe, label);
+    entry->status = status;
+    entry->duration_us = duration_us;
+    if (rss_kb > 0)
+        entry->rss_kb = rss_kb;
+}
+
+
+void history_save(history_t *history, const char *path) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp_path, "w");
+    if (fp == NULL) {
+        perror(tmp_path);
+        return;
+    }
+    for (long i = 0; i < history->entries.capacity; i++) {
+        history_entry_t *entry = hash_table_slot(&history->entries, i);
+        if (entry == NULL)
+            continue;
+        fprintf(fp, "%s %s %d %lld", entry->exe, entry->label, entry->status, entry->duration_us);
+        if (entry->rss_kb > 0)
+            fprintf(fp, " %ld", entry->rss_kb);
+        fputc('\n', fp);
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, path) == -1) {
+        perror("Failed to write history");
+        unlink(tmp_path);
+    }
+}
+
+
+void history_free(history_t *history) {
+    hash_table_free(&history->entries);
+
+    hash_table_free(&history->averages);
+    free(history);
+}
+
+
+// Longest first; the index breaks ties, which makes qsort() stable
+static int compare_predicted(const void *a, const void *b, void *predicted) {
+    int i = *(const int *) a, j = *(const int *) b;
+    long long pi = ((const long long *) predicted)[i], pj = ((const long long *) predicted)[j];
+    if (pi != pj)
+        return pi > pj ? -1 : 1;
+    return i - j;
+}
+
+
+void history_sort(int *order, const long long *predicted, int n) {
+    qsort_r(order, n, sizeof(int), compare_predicted, (void *) predicted);
+}
+
+
+long long history_makespan(const int *order, const long long *predicted, int n, int batch_size) {
+    long long makespan = 0;
+    for (int start = 0; start < n; start += batch_size) {
+        long long longest = 0;
+        for (int k = start; k < n && k < start + batch_size; k++) {
+            if (predicted[order[k]] > longest)
+                longest = predicted[order[k]];
+        }
+        makespan += longest;
+    }
+    return makespan;
+}
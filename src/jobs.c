@@ -0,0 +1,134 @@
+#include "utils.h"
+#include "jobs.h"
+
+
+// Parse one line of the job file (modified in place) into job, exits if malformed
+static void parse_job(job_t *job, char *line, const char *path, int line_number) {
+    int capacity = 16, argc = 0;
+    char **argv = malloc(capacity * sizeof(char *));
+    char *save;
+    for (char *token = strtok_r(line, " \t\r\n", &save); token != NULL; token = strtok_r(NULL, " \t\r\n", &save)) {
+        if (argc + 1 >= capacity) {
+            capacity *= 2;
+            argv = realloc(argv, capacity * sizeof(char *));
+        }
+        argv[argc++] = token;
+    }
+    argv[argc] = NULL;
+
+    job->line = line;
+    job->argv = argv;
+    job->name = argv[0];
+
+    char *weight = take_option(&argc, argv, "--weight");
+    char *priority = take_option(&argc, argv, "--priority");
+    char *timeout = take_option(&argc, argv, "--timeout");
+    char *results = take_option(&argc, argv, "--results");
+    char *scores = take_option(&argc, argv, "--scores");
+    char *delta = take_option(&argc, argv, "--delta");
+
+    job->weight = weight != NULL ? atof(weight) : 1;
+    job->priority = priority != NULL ? atoi(priority) : 0;
+    job->timeout_secs = timeout != NULL ? atoi(timeout) : TIMEOUT_SECS;
+    if (argc < 2 || job->weight <= 0 || job->timeout_secs <= 0) {
+        fprintf(stderr, "%s:%d: bad job (expected <name> <solutions dir> [--weight <w>] [--priority <p>]"
+                " [--timeout <secs>] [--results <file>] [--scores <file>] [--delta <file>] <parameters>)\n", path, line_number);
+        exit(1);
+    }
+    job->testdir = argv[1];
+
+    if (results != NULL) {
+        job->results_path = strdup(results);
+    } else {
+        job->results_path = malloc(strlen(job->name) + sizeof(".results.txt"));
+        sprintf(job->results_path, "%s.results.txt", job->name);
+    }
+    if (scores != NULL) {
+        job->scores_path = strdup(scores);
+    } else {
+        job->scores_path = malloc(strlen(job->name) + sizeof(".scores.txt"));
+        sprintf(job->scores_path, "%s.scores.txt", job->name);
+    }
+
+    job->delta_path = delta != NULL ? strdup(delta) : NULL;
+
+    job->params = param_source_from_args(&argc, argv, 2);
+    if (job->params->count == 0) {
+        fprintf(stderr, "%s:%d: job %s has no parameters\n", path, line_number, job->name);
+        exit(1);
+    }
+}
+
+
+job_t *jobs_load(const char *path, int *num_jobs) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror("Failed to open job file");
+        exit(1);
+    }
+
+    job_t *jobs = NULL;
+    int n = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    for (int line_number = 1; getline(&line, &cap, fp) != -1; line_number++) {
+        char *start = line + strspn(line, " \t\r\n");
+        if (*start == '\0' || *start == '#')
+            continue;
+
+        jobs = realloc(jobs, (n + 1) * sizeof(job_t));
+        memset(&jobs[n], 0, sizeof(job_t));
+        parse_job(&jobs[n], strdup(start), path, line_number);
+
+        // Output files of different jobs must differ
+        for (int k = 0; k < n; k++) {
+            if (strcmp(jobs[k].name, jobs[n].name) == 0 || strcmp(jobs[k].results_path, jobs[n].results_path) == 0
+                || strcmp(jobs[k].scores_path, jobs[n].scores_path) == 0) {
+                fprintf(stderr, "%s:%d: job %s has the name or an output file of job %s\n",
+                        path, line_number, jobs[n].name, jobs[k].name);
+                exit(1);
+            }
+        }
+        n++;
+    }
+    free(line);
+    fclose(fp);
+
+    if (n == 0) {
+        fprintf(stderr, "No jobs in %s\n", path);
+        exit(1);
+    }
+    *num_jobs = n;
+    return jobs;
+}
+
+
+int jobs_next(job_t *jobs, int num_jobs) {
+    int next = -1;
+    for (int j = 0; j < num_jobs; j++) {
+        if (jobs[j].done)
+            continue;
+        if (next == -1 || jobs[j].priority > jobs[next].priority
+            || (jobs[j].priority == jobs[next].priority && jobs[j].used < jobs[next].used))
+            next = j;
+    }
+    return next;
+}
+
+
+void jobs_charge(job_t *job, long long slot_us) {
+    job->used += slot_us / job->weight;
+}
+
+
+void jobs_free(job_t *jobs, int num_jobs) {
+    for (int j = 0; j < num_jobs; j++) {
+        param_source_close(jobs[j].params);
+        free(jobs[j].results_path);
+        free(jobs[j].scores_path);
+        free(jobs[j].delta_path);
+        free(jobs[j].argv);
+        free(jobs[j].line);
+    }
+    free(jobs);
+}
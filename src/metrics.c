@@ -0,0 +1,225 @@
+#include "utils.h"
+#include "metrics.h"
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/prctl.h>
+
+metrics_t *metrics = NULL;
+
+const long long metrics_spawn_bounds_us[METRICS_SPAWN_BUCKETS] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 50000, 250000
+};
+
+int metrics_shm_id = -1;        // Shared memory segment holding the counters
+pid_t metrics_server_pid = -1;  // Server process (coordinator only)
+char metrics_socket_path[108];  // sizeof(sun_path)
+
+
+// Read a counter another process may be updating
+static long metrics_get(long *field) {
+    return __atomic_load_n(field, __ATOMIC_RELAXED);
+}
+
+
+// Format the current counters in Prometheus text exposition format
+static int metrics_format(char *buf, int size) {
+    int n = 0;
+    long total = metrics_get(&metrics->pairs_total);
+    long done = metrics_get(&metrics->pairs_done);
+
+    n += snprintf(buf + n, size - n,
+        "# TYPE autograder_pairs_total gauge\n"
+        "autograder_pairs_total %ld\n"
+        "# TYPE autograder_pairs_done counter\n"
+        "autograder_pairs_done %ld\n"
+        "# TYPE autograder_pairs_remaining gauge\n"
+        "autograder_pairs_remaining %ld\n",
+        total, done, total - done);
+
+    n += snprintf(buf + n, size - n, "# TYPE autograder_outcomes_total counter\n");
+    for (int s = 1; s <= METRICS_MAX_STATUS; s++) {
+        const char *message = get_status_message(s);
+        if (strcmp(message, "unknown") == 0)
+            continue;
+        n += snprintf(buf + n, size - n, "autograder_outcomes_total{status=\"%s\"} %ld\n",
+                      message, metrics_get(&metrics->outcomes[s]));
+    }
+
+    n += snprintf(buf + n, size - n,
+        "# TYPE autograder_in_flight gauge\n"
+        "autograder_in_flight %ld\n"
+        "# TYPE autograder_timeout_kills_total counter\n"
+        "autograder_timeout_kills_total %ld\n"
+        "# TYPE autograder_timeout_rechecks_total counter\n"
+        "autograder_timeout_rechecks_total %ld\n"
+        "# TYPE autograder_timeout_overturned_total counter\n"
+        "autograder_timeout_overturned_total %ld\n",
+        metrics_get(&metrics->in_flight), metrics_get(&metrics->timeout_kills),
+        metrics_get(&metrics->timeout_rechecks), metrics_get(&metrics->timeout_overturned));
+
+    // Prometheus histogram buckets are cumulative
+    n += snprintf(buf + n, size - n, "# TYPE autograder_spawn_latency_seconds histogram\n");
+    long cumulative = 0;
+    for (int b = 0; b < METRICS_SPAWN_BUCKETS; b++) {
+        cumulative += metrics_get(&metrics->spawn_buckets[b]);
+        n += snprintf(buf + n, size - n, "autograder_spawn_latency_seconds_bucket{le=\"%g\"} %ld\n",
+                      metrics_spawn_bounds_us[b] / 1e6, cumulative);
+    }
+    cumulative += metrics_get(&metrics->spawn_buckets[METRICS_SPAWN_BUCKETS]);
+    n += snprintf(buf + n, size - n,
+        "autograder_spawn_latency_seconds_bucket{le=\"+Inf\"} %ld\n"
+        "autograder_spawn_latency_seconds_sum %g\n"
+        "autograder_spawn_latency_seconds_count %ld\n",
+        cumulative, metrics_get(&metrics->spawn_sum_us) / 1e6, cumulative);
+
+    // Queue depth is read straight from the kernel at scrape time
+    struct msqid_ds ds;
+    if (metrics->msqid != -1 && msgctl(metrics->msqid, IPC_STAT, &ds) == 0) {
+        n += snprintf(buf + n, size - n,
+            "# TYPE autograder_queue_depth gauge\n"
+            "autograder_queue_depth %lu\n",
+            (unsigned long) ds.msg_qnum);
+    }
+
+    return n;
+}
+
+
+// Server loop: answer every connection with the current counters
+static void metrics_serve(int listen_fd) {
+    // Don't outlive the grader, and don't inherit its timeout handling
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    signal(SIGALRM, SIG_DFL);
+
+    while (1) {
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("metrics accept");
+            exit(1);
+        }
+
+        // Consume the request (if any) - it's always answered the same way
+        char request[1024];
+        struct timeval tv = {0, 100000};
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        read(conn, request, sizeof(request));
+
+        char body[8192];
+        int body_len = metrics_format(body, sizeof(body));
+
+        char header[256];
+        int header_len = sprintf(header,
+            "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %d\r\n\r\n", body_len);
+
+        write(conn, header, header_len);
+        write(conn, body, body_len);
+        close(conn);
+    }
+}
+
+
+void metrics_start(const char *socket_path, long pairs_total, int msqid) {
+    metrics_shm_id = shmget(IPC_PRIVATE, sizeof(metrics_t), IPC_CREAT | 0600);
+    if (metrics_shm_id == -1) {
+        perror("Failed to create metrics shared memory");
+        exit(1);
+    }
+    metrics_attach(metrics_shm_id);
+
+    memset(metrics, 0, sizeof(metrics_t));
+    metrics->pairs_total = pairs_total;
+    metrics->msqid = msqid;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Metrics socket path too long: %s\n", socket_path);
+        exit(1);
+    }
+    strcpy(addr.sun_path, socket_path);
+    strcpy(metrics_socket_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        perror("Failed to create metrics socket");
+        exit(1);
+    }
+
+    // Replace a stale socket left behind by a previous run
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(listen_fd, 8) == -1) {
+        perror("Failed to listen on metrics socket");
+        exit(1);
+    }
+
+    metrics_server_pid = fork();
+    if (metrics_server_pid == 0) {
+        metrics_serve(listen_fd);
+        exit(0);
+    } else if (metrics_server_pid == -1) {
+        perror("Failed to fork metrics server");
+        exit(1);
+    }
+
+    close(listen_fd);
+}
+
+
+void metrics_attach(int shmid) {
+    metrics = shmat(shmid, NULL, 0);
+    if (metrics == (void *) -1) {
+        perror("Failed to attach metrics shared memory");
+        exit(1);
+    }
+    metrics_shm_id = shmid;
+}
+
+
+int metrics_shmid() {
+    return metrics_shm_id;
+}
+
+
+void metrics_stop() {
+    if (!METRICS_ON)
+        return;
+
+    if (metrics_server_pid > 0) {
+        kill(metrics_server_pid, SIGTERM);
+        waitpid(metrics_server_pid, NULL, 0);
+        unlink(metrics_socket_path);
+        shmctl(metrics_shm_id, IPC_RMID, NULL);
+    }
+
+    shmdt(metrics);
+    metrics = NULL;
+}
+
+
+void metrics_pair_done(int status) {
+    if (!METRICS_ON)
+        return;
+
+    METRICS_ADD(pairs_done, 1);
+    if (status >= 0 && status <= METRICS_MAX_STATUS)
+        METRICS_ADD(outcomes[status], 1);
+}
+
+
+void metrics_spawn_latency(long long latency_us) {
+    if (!METRICS_ON)
+        return;
+
+    int b = 0;
+    while (b < METRICS_SPAWN_BUCKETS && latency_us > metrics_spawn_bounds_us[b]) {
+        b++;
+    }
+    METRICS_ADD(spawn_buckets[b], 1);
+    METRICS_ADD(spawn_sum_us, latency_us);
+}
@@ -1,109 +1,485 @@
 #include "utils.h"
-
-pid_t *workers;          // Workers determined by batch size
+#include "trace.h"
+#include "metrics.h"
+#include "profile.h"
+#include "contain.h"
+#include "history.h"
+#include "delta.h"
+#include "workers.h"
+
+pid_t *workers;          // Workers determined by batch size (0 for an empty slot)
 int *worker_done;        // 1 for done, 0 for still running
+int *worker_acked;       // 1 once the worker has received all of its pairs (ACK)
+long long *worker_heard_at;  // When each worker last sent anything (heartbeat)
+long long run_start;     // When the workers were told to start testing
 
 // Stores the results of the autograder (see utils.h for details)
 autograder_results_t *results;
 
 int num_executables;      // Number of executables in test directory
-int total_params;         // Total number of parameters to test - (argc - 2)
+int total_params;         // Total number of parameters to test (see params.h)
 int num_workers;          // Number of workers to spawn
 
+char *trace_path;         // --trace output file (NULL when tracing is disabled)
+char *expected_dir;       // --expected golden output directory, handed to the workers
+char *compare_spec;       // --compare mode, handed to the workers
+int staging;              // --stage, handed to the workers (see stage.h)
 
-void launch_worker(int msqid, int pairs_per_worker, int worker_id) {
-    
-    pid_t pid = fork();
+// Coordinator's track in the trace timeline (workers use their worker id)
+#define COORDINATOR_TID 0
 
-    // Child process
-    if (pid == 0) {
+// How often the workers are checked on while waiting for their messages
+#define WORKER_CHECK_SECS 1
 
-        // TODO: exec() the worker program and pass it the message queue id and worker id.
-        //       Use ./worker as the path to the worker program.
+// Worker failure handling (see workers.h). Pair p is (executable p % num_executables,
+// parameter p / num_executables).
+pairs_t pairs;
 
-        perror("Failed to spawn worker");
-        exit(1);
-    } 
-    // Parent process
-    else if (pid > 0) {
-        // TODO: Send the total number of pairs to worker via message queue (mtype = worker_id)
-        
-
-        // Store the worker's pid for monitoring
-        workers[worker_id - 1] = pid;
-    }
-    // Fork failed 
-    else {
-        perror("Failed to fork worker");
-        exit(1);
+// Scheduling (only with --history, see history.h). The parameters are then kept in
+// memory, since pairs are no longer sent in parameter order.
+history_t *history;       // Run times of previous runs (NULL without --history)
+char **param_values;      // Every parameter
+int *param_lens;
+
+void check_workers(int msqid);
+
+
+// Send a message to the queue, exit on failure. A message for a worker that turns
+// out to have exited is dropped (its pairs are orphaned, see worker_exited()).
+void send_msg(int msqid, long mtype, char *text) {
+    msgbuf_t msg;
+    msg.mtype = mtype;
+    strncpy(msg.mtext, text, MESSAGE_SIZE - 1);
+    msg.mtext[MESSAGE_SIZE - 1] = '\0';
+
+    // Interrupted when a worker exits and every WORKER_CHECK_SECS (see watch_workers()),
+    // so a full queue that a dead worker will never drain can't block us for good
+    while (msgsnd(msqid, &msg, MESSAGE_SIZE, 0) == -1) {
+        if (errno != EINTR) {
+            perror("Failed to send message");
+            exit(1);
+        }
+        check_workers(msqid);
+        if (mtype != BROADCAST_MTYPE && workers[mtype - BROADCAST_MTYPE - 1] == 0)
+            return;
+    }
+
+    if (TRACE_ON) {
+        char detail[MESSAGE_SIZE + 32];
+        sprintf(detail, "mtype %ld: %s", mtype, msg.mtext);
+        trace_instant("msgsnd", COORDINATOR_TID, detail);
     }
 }
 
 
-// TODO: Receive ACK from all workers using message queue (mtype = BROADCAST_MTYPE)
-void receive_ack_from_workers(int msqid, int num_workers) {
-    
+void launch_worker(int msqid, int pairs_per_worker, int worker_id) {
+    // TODO: exec() the worker program and pass it the message queue id and worker id.
+    //       Use ./worker as the path to the worker program.
+    worker_options_t options = { trace_path, METRICS_ON ? metrics_shmid() : -1, PROFILE_ON ? profile_shmid() : -1,
+                                 expected_dir, compare_spec, staging, 0 };
+    pid_t pid = worker_spawn(msqid, worker_id, &options);
+
+    // Store the worker's pid for monitoring (before sending, see send_msg())
+    workers[worker_id - 1] = pid;
+    worker_done[worker_id - 1] = 0;
+    worker_acked[worker_id - 1] = 0;
+    worker_heard_at[worker_id - 1] = get_time_us();
+
+    // TODO: Send the total number of pairs to worker via message queue (mtype = PAIRS_MTYPE(worker_id))
+    char text[MESSAGE_SIZE];
+    sprintf(text, "%d", pairs_per_worker);
+    send_msg(msqid, PAIRS_MTYPE(worker_id), text);
 }
 
 
-// TODO: Send SYNACK to all workers using message queue (mtype = BROADCAST_MTYPE)
-void send_synack_to_workers(int msqid, int num_workers) {
-    
+// Send an (executable, parameter) pair to a worker. The parameter goes last since
+// it may contain spaces.
+void send_pair(int msqid, long worker_id, char *exe_path, int param_idx, char *param, int param_len) {
+    char text[MESSAGE_SIZE];
+    int len = snprintf(text, MESSAGE_SIZE, "%s %d %s", exe_path, param_idx, param);
+    if (len >= MESSAGE_SIZE || (int) strlen(param) != param_len) {
+        fprintf(stderr, "Parameter #%d doesn't fit in a message queue message\n", param_idx + 1);
+        exit(1);
+    }
+    send_msg(msqid, PAIRS_MTYPE(worker_id), text);
 }
 
 
-// Wait for all workers to finish and collect their results from message queue
-void wait_for_workers(int msqid, int pairs_to_test, char **argv_params) {
-    int received = 0;
-    worker_done = malloc(num_workers * sizeof(int));
-    for (int i = 0; i < num_workers; i++) {
-        worker_done[i] = 0;
+// Hand pair p (with its parameter) to worker w, or orphan it if w is gone
+void dispatch_pair(int msqid, int w, int p, char *param, int param_len) {
+    if (workers[w] == 0) {
+        pairs_assign(&pairs, p, -1);
+        return;
     }
+    pairs_assign(&pairs, p, w);
+    send_pair(msqid, w + 1, results[p % num_executables].exe_path, p / num_executables, param, param_len);
+}
 
-    while (received < pairs_to_test) {
-        for (int i = 0; i < num_workers; i++) {
-            if (worker_done[i] == 1) {
-                continue;
+
+// Longest-expected-first dispatch (see history.h): taking the pairs longest first,
+// each goes to the worker whose predicted finish time it delays least, so every
+// worker also runs its own pairs longest first. Launches the workers with their
+// pair counts and sends them their pairs. Returns the predicted makespan.
+long long dispatch_by_history(int msqid, char **executable_paths, param_source_t *params) {
+    int num_pairs = num_executables * total_params;
+
+    // Pair p is (executable p % num_executables, parameter p / num_executables)
+    param_values = malloc(total_params * sizeof(char *));
+    param_lens = malloc(total_params * sizeof(int));
+    long long *predicted = malloc(num_pairs * sizeof(long long));
+    int *order = malloc(num_pairs * sizeof(int));
+
+    char *param;
+    int param_len;
+    for (int i = 0; (param = param_source_next(params, &param_len)) != NULL; i++) {
+        param_values[i] = malloc(param_len + 1);
+        memcpy(param_values[i], param, param_len + 1);
+        param_lens[i] = param_len;
+
+        char label[PARAM_LABEL_MAX + 1];
+        param_label(label, param, param_len, i);
+        for (int j = 0; j < num_executables; j++) {
+            order[i * num_executables + j] = i * num_executables + j;
+            predicted[i * num_executables + j] = history_predict(history, get_exe_name(executable_paths[j]), label);
+        }
+    }
+    history_sort(order, predicted, num_pairs);
+
+    // Workers run lockstep batches, so a pair only adds to a worker's predicted
+    // time when it starts a new batch (the batch's first pair is its longest)
+    int *assigned = malloc(num_pairs * sizeof(int));
+    int *counts = calloc(num_workers, sizeof(int));
+    long long *loads = calloc(num_workers, sizeof(long long));
+    long long makespan = 0;
+    for (int k = 0; k < num_pairs; k++) {
+        int p = order[k];
+        int best = -1;
+        long long best_finish = 0;
+        for (int w = 0; w < num_workers; w++) {
+            long long finish = loads[w] + (counts[w] % PAIRS_BATCH_SIZE == 0 ? predicted[p] : 0);
+            // Equal predictions (e.g. no history at all) -> round robin
+            if (best == -1 || finish < best_finish || (finish == best_finish && counts[w] < counts[best])) {
+                best = w;
+                best_finish = finish;
             }
+        }
+        assigned[p] = best;
+        loads[best] = best_finish;
+        counts[best]++;
+        if (best_finish > makespan)
+            makespan = best_finish;
+    }
+
+    for (int w = 0; w < num_workers; w++) {
+        launch_worker(msqid, counts[w], w + 1);
+    }
+
+    // Each worker's queue is FIFO, so it gets its pairs longest first
+    for (int k = 0; k < num_pairs; k++) {
+        int i = order[k] / num_executables;
+        dispatch_pair(msqid, assigned[order[k]], order[k], param_values[i], param_lens[i]);
+    }
+
+    free(predicted);
+    free(order);
+    free(assigned);
+    free(counts);
+    free(loads);
+    return makespan;
+}
+
 
-            // Check if worker has finished
-            pid_t retpid = waitpid(workers[i], NULL, WNOHANG);
-            
-            int msgflg;
-            if (retpid > 0)
-                // Worker has finished and still has messages to receive
-                msgflg = 0;
-            else if (retpid == 0)
-                // Worker is still running -> receive intermediate results
-                msgflg = IPC_NOWAIT;
-            else {
-                // Error
-                perror("Failed to wait for child process");
-                exit(1);
+// Store a worker's result message in the results struct
+void record_result(msgbuf_t *msg) {
+    // TODO: Receive results from worker and store them in the results struct.
+    //       Messages will have the format ("%s %d %d %lld", executable_path, parameter index, status,
+    //       run time in us) so consider using sscanf() to parse the message.
+    //       With --profile the time the worker sent it follows (see profile.h).
+    long long store_start = PROFILE_ON ? profile_now() : 0;
+    char exe_path[MESSAGE_SIZE];
+    int param_idx, status;
+    long long duration_us, sent_at;
+    int fields = sscanf(msg->mtext, "%s %d %d %lld %lld", exe_path, &param_idx, &status, &duration_us, &sent_at);
+    if (fields < 4) {
+        fprintf(stderr, "Malformed result message: %s\n", msg->mtext);
+        return;
+    }
+    if (fields == 5)
+        profile_record(PROFILE_DELIVER, store_start - sent_at);
+
+    // Find the (executable, parameter) cell of the results struct
+    int exe_idx = 0;
+    while (exe_idx < num_executables && strcmp(results[exe_idx].exe_path, exe_path) != 0) {
+        exe_idx++;
+    }
+    if (exe_idx == num_executables || param_idx < 0 || param_idx >= total_params) {
+        fprintf(stderr, "Unknown pair in result message: %s\n", msg->mtext);
+        return;
+    }
+
+    // Already done (by an earlier owner of the pair)
+    int p = param_idx * num_executables + exe_idx;
+    if (!pairs_finish(&pairs, p))
+        return;
+
+    results[exe_idx].status[param_idx] = status;
+
+    if (history != NULL) {
+        char label[PARAM_LABEL_MAX + 1];
+        param_label(label, param_values[param_idx], param_lens[param_idx], param_idx);
+        history_record(history, get_exe_name(exe_path), label, status, duration_us, 0);
+    }
+
+    metrics_pair_done(status);
+    profile_since(PROFILE_STORE, store_start);
+}
+
+
+// Handle a message of worker w: an ACK, a result or DONE
+void handle_message(int msqid, int w, msgbuf_t *msg) {
+    if (TRACE_ON)
+        trace_instant("msgrcv", COORDINATOR_TID, msg->mtext);
+
+    worker_heard_at[w] = get_time_us();
+
+    if (strcmp(msg->mtext, "ACK") == 0) {
+        worker_acked[w] = 1;
+        // A replacement starts right away (the others are told all at once, see wait_for_workers())
+        if (run_start != 0)
+            send_msg(msqid, BROADCAST_MTYPE, "SYNACK");
+        return;
+    }
+
+    if (strcmp(msg->mtext, "DONE") == 0) {
+        worker_done[w] = 1;
+        return;
+    }
+
+    record_result(msg);
+}
+
+
+// Launch a worker in the empty slot w with every orphaned pair
+void reassign_orphans(int msqid, int w, param_source_t *params) {
+    // Taken off the list first: if the new worker dies too, they are orphaned again
+    int n;
+    int *taken = pairs_take_orphans(&pairs, &n);
+    launch_worker(msqid, n, w + 1);
+
+    if (param_values != NULL) {
+        for (int k = 0; k < n; k++) {
+            int i = taken[k] / num_executables;
+            dispatch_pair(msqid, w, taken[k], param_values[i], param_lens[i]);
+        }
+    } else {
+        // Stream the parameters once, the pairs are in parameter order
+        char *param;
+        int param_len;
+        param_source_rewind(params);
+        int k = 0;
+        for (int i = 0; k < n && (param = param_source_next(params, &param_len)) != NULL; i++) {
+            for (; k < n && taken[k] / num_executables == i; k++) {
+                dispatch_pair(msqid, w, taken[k], param, param_len);
             }
+        }
+    }
+    free(taken);
+}
+
+
+// A worker that finished normally can take over orphaned pairs
+static int slot_state(int w) {
+    if (workers[w] != 0)
+        return SLOT_BUSY;
+    return worker_done[w] ? SLOT_IDLE : SLOT_DEAD;
+}
+
+
+// Give the orphaned pairs to a new worker (see pairs_orphan_slot()). Returns 0 if
+// there are orphans but no slot for them.
+int place_orphans(int msqid, param_source_t *params) {
+    if (pairs.num_orphaned == 0)
+        return 1;
+
+    int w = pairs_orphan_slot(&pairs, num_workers, slot_state);
+    if (w == -1)
+        return 0;
+    reassign_orphans(msqid, w, params);
+    return 1;
+}
+
 
-            // TODO: Receive results from worker and store them in the results struct.
-            //       If message is "DONE", set worker_done[i] to 1 and break out of loop.
-            //       Messages will have the format ("%s %d %d", executable_path, parameter, status)
-            //       so consider using sscanf() to parse the message.
-            while (1) {
-                
+// Worker w has exited with the given wait status: collect what it sent, and if it
+// died before it was done, orphan its unfinished pairs (see place_orphans())
+void worker_exited(int msqid, int w, int status) {
+    pid_t pid = workers[w];
+    workers[w] = 0;
+
+    msgbuf_t msg;
+    while (msgrcv(msqid, &msg, MESSAGE_SIZE, w + 1, IPC_NOWAIT) != -1) {
+        handle_message(msqid, w, &msg);
+    }
+
+    // Finished normally -> the slot can take over orphaned pairs
+    if (worker_done[w])
+        return;
+
+    // Kill whatever it was running, and drop the pairs it never received
+    contain_bury(pid);
+    while (msgrcv(msqid, &msg, MESSAGE_SIZE, PAIRS_MTYPE(w + 1), IPC_NOWAIT) != -1) {
+    }
+
+    int unfinished = pairs_orphan(&pairs, w);
+
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "Worker %d (pid %d) was killed by signal %d with %d pair(s) left\n",
+                w + 1, pid, WTERMSIG(status), unfinished);
+    } else {
+        fprintf(stderr, "Worker %d (pid %d) exited with status %d with %d pair(s) left\n",
+                w + 1, pid, WEXITSTATUS(status), unfinished);
+    }
+    if (TRACE_ON) {
+        char detail[32];
+        sprintf(detail, "worker %d", w + 1);
+        trace_instant("worker-died", COORDINATOR_TID, detail);
+    }
+}
+
+
+// Check on every worker: reap the ones that exited and kill the ones that hung
+void check_workers(int msqid) {
+    static int checking;     // Not again from a send_msg() of its own
+    if (checking)
+        return;
+    checking = 1;
+
+    for (int w = 0; w < num_workers; w++) {
+        if (workers[w] == 0)
+            continue;
+
+        int status;
+        pid_t retpid = waitpid(workers[w], &status, WNOHANG);
+        if (retpid == 0 && run_start != 0 && !worker_done[w]
+            && worker_kill_if_hung(workers[w], w + 1, worker_heard_at[w])) {
+            retpid = waitpid(workers[w], &status, 0);
+        }
+
+        if (retpid == -1) {
+            perror("Failed to wait for child process");
+            exit(1);
+        }
+        if (retpid > 0)
+            worker_exited(msqid, w, status);
+    }
+    checking = 0;
+}
+
+
+// Interrupts msgsnd() and msgrcv(), so the workers get checked
+static void wake_up(int signum) {
+}
+
+
+// From now on check on the workers whenever one exits, and at least every WORKER_CHECK_SECS
+void watch_workers() {
+    struct sigaction sa = {0};
+    sa.sa_handler = wake_up;
+    sigaction(SIGCHLD, &sa, NULL);
+    sigaction(SIGALRM, &sa, NULL);
+    struct itimerval check = { { WORKER_CHECK_SECS, 0 }, { WORKER_CHECK_SECS, 0 } };
+    setitimer(ITIMER_REAL, &check, NULL);
+}
+
+
+// TODO: Send SYNACK to all workers using message queue (mtype = BROADCAST_MTYPE)
+void send_synack_to_workers(int msqid, int num_workers) {
+    for (int i = 0; i < num_workers; i++) {
+        send_msg(msqid, BROADCAST_MTYPE, "SYNACK");
+    }
+}
+
+
+// Start the workers once they all have their pairs, then wait until every pair has
+// been tested (by whichever worker) and collect the results from the message queue
+void wait_for_workers(int msqid, int pairs_to_test, param_source_t *params) {
+    while (pairs.num_done < pairs_to_test) {
+        check_workers(msqid);
+        int placed = place_orphans(msqid, params);
+
+        int live = 0, acked = 0;
+        for (int w = 0; w < num_workers; w++) {
+            live += workers[w] != 0;
+            acked += workers[w] != 0 && worker_acked[w];
+        }
+        if (pairs.num_done == pairs_to_test)
+            break;
+        if (live == 0 && !placed) {
+            fprintf(stderr, "No workers left, %d pair(s) couldn't be tested\n", pairs_to_test - pairs.num_done);
+            break;
+        }
+        if (live == 0)
+            continue;
+
+        // TODO: Wait for ACK from workers to tell all workers to start testing (synchronization)
+        if (run_start == 0 && acked == live) {
+            send_synack_to_workers(msqid, live);
+            run_start = get_time_us();
+            for (int w = 0; w < num_workers; w++) {
+                worker_heard_at[w] = run_start;
             }
         }
+
+        // Messages of any worker (see PAIRS_MTYPE in utils.h)
+        msgbuf_t msg;
+        if (msgrcv(msqid, &msg, MESSAGE_SIZE, -num_workers, 0) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("Failed to receive results");
+            exit(1);
+        }
+        handle_message(msqid, msg.mtype - 1, &msg);
     }
 
-    free(worker_done);
+    struct itimerval off = { { 0, 0 }, { 0, 0 } };
+    setitimer(ITIMER_REAL, &off, NULL);
+    signal(SIGCHLD, SIG_DFL);
+
+    // The workers only have their DONE left to send
+    for (int w = 0; w < num_workers; w++) {
+        if (workers[w] != 0)
+            waitpid(workers[w], NULL, 0);
+    }
 }
 
 
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        printf("Usage: %s <testdir> <p1> <p2> ... <pn>\n", argv[0]);
+    trace_path = take_option(&argc, argv, "--trace");
+    char *metrics_path = take_option(&argc, argv, "--metrics");
+    expected_dir = take_option(&argc, argv, "--expected");
+    compare_spec = take_option(&argc, argv, "--compare");
+    char *history_path = take_option(&argc, argv, "--history");
+    staging = take_flag(&argc, argv, "--stage");
+    int profiling = take_flag(&argc, argv, "--profile");
+    char *delta_path = take_option(&argc, argv, "--delta");
+    contain_limits_from_args(&argc, argv);
+
+    param_source_t *params = param_source_from_args(&argc, argv, 2);
+
+    if (argc < 2 || params->count == 0) {
+        printf("Usage: %s [--trace <file>] [--metrics <socket>] [--expected <dir> [--compare <mode>]] [--history <file>] [--stage] [--profile] [--delta <file>] [--mem-limit <size>] [--output-limit <size>] [--proc-limit <n>] <testdir> <p1> <p2> ... <pn>\n", argv[0]);
+        printf("       %s [options] <testdir> --params-file <file> | --params-range <a>..<b>[:<step>]"
+               " | --params-random <n>:<lo>..<hi>[@<seed>]\n", argv[0]);
         return 1;
     }
 
+    if (trace_path != NULL) {
+        trace_open(trace_path, 1);
+        trace_process_name("mq_autograder");
+        trace_thread_name(COORDINATOR_TID, "coordinator");
+    }
+
     char *testdir = argv[1];
-    total_params = argc - 2;
+    total_params = params->count;
 
     char **executable_paths = get_student_executables(testdir, &num_executables);
 
@@ -111,8 +487,7 @@ int main(int argc, char *argv[]) {
     results = malloc(num_executables * sizeof(autograder_results_t));
     for (int i = 0; i < num_executables; i++) {
         results[i].exe_path = executable_paths[i];
-        results[i].params_tested = malloc((total_params) * sizeof(int));
-        results[i].status = malloc((total_params) * sizeof(int));
+        results[i].status = calloc(total_params, sizeof(int));     // "unknown" if never tested
     }
 
     num_workers = get_batch_size();
@@ -120,71 +495,130 @@ int main(int argc, char *argv[]) {
     if (num_workers > num_executables * total_params) {
         num_workers = num_executables * total_params;
     }
-    workers = malloc(num_workers * sizeof(pid_t));
+    workers = calloc(num_workers, sizeof(pid_t));
+    worker_done = calloc(num_workers, sizeof(int));
+    worker_acked = calloc(num_workers, sizeof(int));
+    worker_heard_at = malloc(num_workers * sizeof(long long));
+
+    // Whatever a worker that dies leaves running comes back to us (see contain.h)
+    contain_supervise();
 
     // Create a unique key for message queue
     key_t key = IPC_PRIVATE;
 
     // TODO: Create a message queue
-    int msqid;
+    int msqid = msgget(key, IPC_CREAT | 0666);
+    if (msqid == -1) {
+        perror("Failed to create message queue");
+        exit(1);
+    }
+
+    if (metrics_path != NULL) {
+        metrics_start(metrics_path, (long) num_executables * total_params, msqid);
+    }
+    if (profiling) {
+        profile_start();
+    }
 
     int num_pairs_to_test = num_executables * total_params;
-    
-    // Spawn workers and send them the total number of (executable, parameter) pairs they will test
-    for (int i = 0; i < num_workers; i++) {
-        int leftover = num_pairs_to_test % num_workers - i > 0 ? 1 : 0;
-        int pairs_per_worker = num_pairs_to_test / num_workers + leftover;
+    pairs_init(&pairs, num_pairs_to_test);
+    char *param;
+    int param_len;
 
-        // TODO: Spawn worker and send it the number of pairs it will test via message queue
-        launch_worker(msqid, pairs_per_worker, i + 1);
-    }
+    long long predicted_makespan = 0;
+    if (history_path != NULL)
+        history = history_load(history_path);
 
-    // Send (executable, parameter) pairs to workers
-    int sent = 0;
-    for (int i = 0; i < total_params; i++) {
-        for (int j = 0; j < num_executables; j++) {
-            msgbuf_t msg;
-            long worker_id = sent % num_workers + 1;
-            
-            // TODO: Send (executable, parameter) pair to worker via message queue (mtype = worker_id)
+    // A worker can die while we're still sending pairs
+    watch_workers();
 
-            sent++;
-        }
-    }
+    if (history != NULL) {
+        predicted_makespan = dispatch_by_history(msqid, executable_paths, params);
+    } else {
+        // Spawn workers and send them the total number of (executable, parameter) pairs they will test
+        for (int i = 0; i < num_workers; i++) {
+            int leftover = num_pairs_to_test % num_workers - i > 0 ? 1 : 0;
+            int pairs_per_worker = num_pairs_to_test / num_workers + leftover;
 
-    // TODO: Wait for ACK from workers to tell all workers to start testing (synchronization)
-    receive_ack_from_workers(msqid, num_workers);
+            // TODO: Spawn worker and send it the number of pairs it will test via message queue
+            launch_worker(msqid, pairs_per_worker, i + 1);
+        }
 
-    // TODO: Send message to workers to allow them to start testing
-    send_synack_to_workers(msqid, num_workers);
+        // Send (executable, parameter) pairs to workers round robin, streaming the parameters
+        int sent = 0;
+        for (int i = 0; (param = param_source_next(params, &param_len)) != NULL; i++) {
+            for (int j = 0; j < num_executables; j++) {
+                // TODO: Send (executable, parameter) pair to worker via message queue (mtype = worker_id)
+                dispatch_pair(msqid, sent % num_workers, sent, param, param_len);
+                sent++;
+            }
+        }
+    }
 
     // TODO: Wait for all workers to finish and collect their results from message queue
-    wait_for_workers(msqid, num_pairs_to_test, argv + 2);
+    wait_for_workers(msqid, num_pairs_to_test, params);
+
+    if (history != NULL) {
+        printf("Makespan: %.2f s (predicted %.2f s)\n", (get_time_us() - run_start) / 1e6, predicted_makespan / 1e6);
+        history_save(history, history_path);
+        history_free(history);
+        for (int i = 0; i < total_params; i++) {
+            free(param_values[i]);
+        }
+        free(param_values);
+        free(param_lens);
+    }
 
     // TODO: Remove ALL output files (output/<executable>.<input>)
+    // (with --expected, outputs are compared through pipes and no files are written)
+    param_source_rewind(params);
+    for (int i = 0; expected_dir == NULL && (param = param_source_next(params, &param_len)) != NULL; i++) {
+        char label[PARAM_LABEL_MAX + 1];
+        param_label(label, param, param_len, i);
+        remove_output_files(results, num_executables, num_executables, label);
+    }
 
+    // Changes from the previous run's results (see delta.h)
+    delta_t *delta = delta_path != NULL ? delta_begin(results_path, scores_path) : NULL;
 
-    write_results_to_file(results, num_executables, total_params);
+    write_results_to_file(results, num_executables, params);
 
     // You can use this to debug your scores function
     // get_score("results.txt", results[0].exe_path);
 
     // Print each score to scores.txt
-    write_scores_to_file(results, num_executables, "results.txt");
+    write_scores_to_file(results, num_executables, results_path);
+
+    if (delta != NULL) {
+        FILE *delta_out = delta_open(delta_path);
+        printf("Delta: %d rows changed\n", delta_end(delta, delta_out));
+        fclose(delta_out);
+    }
 
     // TODO: Remove the message queue
+    if (msgctl(msqid, IPC_RMID, NULL) == -1) {
+        perror("Failed to remove message queue");
+        exit(1);
+    }
 
+    trace_close();
+    metrics_stop();
+    profile_stop(stdout);
 
     // Free the results struct and its fields
     for (int i = 0; i < num_executables; i++) {
         free(results[i].exe_path);
-        free(results[i].params_tested);
         free(results[i].status);
     }
 
     free(results);
     free(executable_paths);
     free(workers);
+    free(worker_done);
+    free(worker_acked);
+    free(worker_heard_at);
+    pairs_free(&pairs);
+    param_source_close(params);
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,489 @@
+#include "utils.h"
+#include "contain.h"
+#include "pool.h"
+#include "workers.h"
+#include <sys/socket.h>
+#include <stdarg.h>
+
+// How often the workers are checked on (besides whenever one exits)
+#define WORKER_CHECK_SECS 1
+
+pid_t *workers;           // Persistent workers (0 for an empty slot)
+int num_workers;          // Number of workers to keep running
+int msqid = -1;           // The pool's message queue
+char *socket_path;        // Where jobs are submitted (see pool.h)
+
+char *expected_dir;       // --expected golden output directory, handed to the workers
+char *compare_spec;       // --compare mode, handed to the workers
+int staging;              // --stage, handed to the workers (see stage.h)
+
+volatile sig_atomic_t pool_stop;    // Set by SIGINT/SIGTERM
+
+// The current job. Pair p is (executable p % num_executables, parameter p / num_executables).
+char **executable_paths;
+int num_executables;
+int num_params;
+char **param_values;
+int *worker_pairs;        // Pairs each worker got, 0 once it is done with them
+long long *worker_heard_at;   // When each worker got its pairs or last sent anything (heartbeat)
+pairs_t pairs;            // Who has which pair, for the pairs of workers that die (see workers.h)
+FILE *client;             // The job's connection (NULL once the client is gone)
+
+sigset_t check_signals;   // SIGCHLD and SIGALRM, which make the pool check on its workers
+
+
+void check_workers();
+
+
+// Send a message to the queue, exit on failure. A message for a worker that turns
+// out to have exited is dropped (its pairs are orphaned, see check_workers()).
+void send_msg(long mtype, char *text) {
+    msgbuf_t msg;
+    msg.mtype = mtype;
+    strncpy(msg.mtext, text, MESSAGE_SIZE - 1);
+    msg.mtext[MESSAGE_SIZE - 1] = '\0';
+
+    // Interrupted when a worker exits, every WORKER_CHECK_SECS and when the pool is
+    // stopped, so a full queue that a dead worker will never drain can't block us for good
+    while (msgsnd(msqid, &msg, MESSAGE_SIZE, 0) == -1) {
+        if (errno != EINTR) {
+            perror("Failed to send message");
+            exit(1);
+        }
+        check_workers();
+        if (workers[mtype - BROADCAST_MTYPE - 1] == 0)
+            return;
+    }
+}
+
+
+// Write a line of the answer to the client (see pool.h), unless it has gone away
+void reply(const char *format, ...) {
+    if (client == NULL)
+        return;
+
+    // Not interrupted by the worker checks, the socket's timeout bounds it instead
+    sigprocmask(SIG_BLOCK, &check_signals, NULL);
+    va_list args;
+    va_start(args, format);
+    vfprintf(client, format, args);
+    va_end(args);
+    if (fflush(client) == EOF) {
+        fclose(client);
+        client = NULL;
+    }
+    sigprocmask(SIG_UNBLOCK, &check_signals, NULL);
+}
+
+
+// Start a persistent worker in slot w
+void launch_worker(int w) {
+    worker_options_t options = { NULL, -1, -1, expected_dir, compare_spec, staging, 1 };
+    workers[w] = worker_spawn(msqid, w + 1, &options);
+}
+
+
+// Forward a worker's result message to the client, returns 1 if it completed a pair
+int record_result(msgbuf_t *msg) {
+    char exe_path[MESSAGE_SIZE];
+    int param_idx, status;
+    long long duration_us;
+    if (sscanf(msg->mtext, "%s %d %d %lld", exe_path, &param_idx, &status, &duration_us) != 4) {
+        fprintf(stderr, "Malformed result message: %s\n", msg->mtext);
+        return 0;
+    }
+
+    int exe_idx = 0;
+    while (exe_idx < num_executables && strcmp(executable_paths[exe_idx], exe_path) != 0) {
+        exe_idx++;
+    }
+    if (exe_idx == num_executables || param_idx < 0 || param_idx >= num_params) {
+        fprintf(stderr, "Unknown pair in result message: %s\n", msg->mtext);
+        return 0;
+    }
+
+    int p = param_idx * num_executables + exe_idx;
+    if (!pairs_finish(&pairs, p))
+        return 0;
+
+    reply("RESULT %s %d %d %lld\n", exe_path, param_idx, status, duration_us);
+    return 1;
+}
+
+
+// Handle a message of worker w: a result or DONE
+void handle_message(int w, msgbuf_t *msg) {
+    worker_heard_at[w] = get_time_us();
+    if (strcmp(msg->mtext, "DONE") == 0) {
+        worker_pairs[w] = 0;
+        return;
+    }
+    record_result(msg);
+}
+
+
+// Worker w has exited with the given wait status: whatever it sent is collected, the
+// pairs it never received are dropped, and its unfinished pairs of the current job
+// are orphaned (see place_orphans())
+void worker_exited(int w, int status) {
+    pid_t pid = workers[w];
+    msgbuf_t msg;
+    while (msgrcv(msqid, &msg, MESSAGE_SIZE, w + 1, IPC_NOWAIT) != -1) {
+        handle_message(w, &msg);
+    }
+    while (msgrcv(msqid, &msg, MESSAGE_SIZE, PAIRS_MTYPE(w + 1), IPC_NOWAIT) != -1) {
+    }
+    contain_bury(pid);
+    int unfinished = pairs_orphan(&pairs, w);
+
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "Worker %d (pid %d) was killed by signal %d with %d pair(s) left\n",
+                w + 1, pid, WTERMSIG(status), unfinished);
+    } else {
+        fprintf(stderr, "Worker %d (pid %d) exited with status %d with %d pair(s) left\n",
+                w + 1, pid, WEXITSTATUS(status), unfinished);
+    }
+    workers[w] = 0;
+    worker_pairs[w] = 0;
+}
+
+
+// Check on every worker: kill the ones that hung with pairs to test, and reap the
+// ones that exited. Anything else is left behind by a worker (the pool is their
+// subreaper, see contain.h) and only needs reaping.
+void check_workers() {
+    for (int w = 0; w < num_workers; w++) {
+        if (workers[w] == 0 || worker_pairs[w] == 0 || !worker_kill_if_hung(workers[w], w + 1, worker_heard_at[w]))
+            continue;
+        int status;
+        waitpid(workers[w], &status, 0);
+        worker_exited(w, status);
+    }
+
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        int w = 0;
+        while (w < num_workers && workers[w] != pid) {
+            w++;
+        }
+        if (w < num_workers)
+            worker_exited(w, status);
+    }
+}
+
+
+// Hand pair p of the current job to worker w, or orphan it if w is gone
+void dispatch_pair(int w, int p) {
+    if (workers[w] == 0) {
+        pairs_assign(&pairs, p, -1);
+        return;
+    }
+    pairs_assign(&pairs, p, w);
+
+    int i = p / num_executables;
+    char text[MESSAGE_SIZE];
+    snprintf(text, MESSAGE_SIZE, "%s %d %s", executable_paths[p % num_executables], i, param_values[i]);
+    send_msg(PAIRS_MTYPE(w + 1), text);
+}
+
+
+// Send worker w its number of pairs, then the pairs
+void assign_pairs(int w, int *assigned, int n) {
+    char text[MESSAGE_SIZE];
+    worker_pairs[w] = n;
+    worker_heard_at[w] = get_time_us();
+    sprintf(text, "%d", n);
+    send_msg(PAIRS_MTYPE(w + 1), text);
+    for (int k = 0; k < n; k++) {
+        dispatch_pair(w, assigned[k]);
+    }
+}
+
+
+// A worker that is done with its pairs can take over orphaned pairs
+static int slot_state(int w) {
+    if (workers[w] == 0)
+        return SLOT_DEAD;
+    return worker_pairs[w] == 0 ? SLOT_IDLE : SLOT_BUSY;
+}
+
+
+// Give the orphaned pairs to a worker (see pairs_orphan_slot()), launched again if
+// its slot is dead. They stay orphaned if no slot can take them.
+void place_orphans() {
+    int w = pairs_orphan_slot(&pairs, num_workers, slot_state);
+    if (w == -1)
+        return;
+    if (workers[w] == 0)
+        launch_worker(w);
+
+    // Taken off the list first: if the worker dies too, they are orphaned again
+    int n;
+    int *taken = pairs_take_orphans(&pairs, &n);
+    assign_pairs(w, taken, n);
+    free(taken);
+}
+
+
+// Read a request (see pool.h) from the client, returns -1 if it is malformed
+int read_request(FILE *in, char **testdir) {
+    char *buf = NULL;
+    size_t cap = 0;
+    if (pool_read_string(in, &buf, &cap) <= 0) {
+        free(buf);
+        return -1;
+    }
+    *testdir = strdup(buf);
+
+    num_params = pool_read_string(in, &buf, &cap) > 0 ? atoi(buf) : 0;
+    param_values = calloc(num_params > 0 ? num_params : 1, sizeof(char *));
+    for (int i = 0; i < num_params; i++) {
+        if (pool_read_string(in, &buf, &cap) == -1) {
+            num_params = i;
+            free(buf);
+            return -1;
+        }
+        param_values[i] = strdup(buf);
+    }
+    free(buf);
+    return num_params > 0 ? 0 : -1;
+}
+
+
+// Grade the job the client connected with sends, streaming the results back
+void run_job(int conn) {
+    struct timeval deadline = { POOL_CLIENT_SECS, 0 };
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &deadline, sizeof(deadline));
+    setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &deadline, sizeof(deadline));
+
+    FILE *in = fdopen(dup(conn), "r");
+    client = fdopen(conn, "w");
+    char *testdir = NULL;
+    num_params = 0;
+    param_values = NULL;
+    executable_paths = NULL;
+
+    // get_student_executables() exits on failure, which mustn't take the pool down
+    struct stat st;
+    sigprocmask(SIG_BLOCK, &check_signals, NULL);
+    int request_ok = read_request(in, &testdir) == 0;
+    sigprocmask(SIG_UNBLOCK, &check_signals, NULL);
+    if (!request_ok) {
+        reply("ERROR Malformed request\n");
+    } else if (testdir[0] != '/' || stat(testdir, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        reply("ERROR %s is not a directory\n", testdir);
+    } else {
+        executable_paths = get_student_executables(testdir, &num_executables);
+
+        // Every pair must fit in a message (see send_pair() in mq_autograder.c)
+        int longest_path = 0, longest_param = 0;
+        for (int e = 0; e < num_executables; e++) {
+            if ((int) strlen(executable_paths[e]) > longest_path)
+                longest_path = strlen(executable_paths[e]);
+        }
+        for (int i = 0; i < num_params; i++) {
+            if ((int) strlen(param_values[i]) > longest_param)
+                longest_param = strlen(param_values[i]);
+        }
+        char last_idx[16];
+        int idx_len = sprintf(last_idx, "%d", num_params - 1);
+        if (num_executables > 0 && longest_path + idx_len + longest_param + 2 >= MESSAGE_SIZE) {
+            reply("ERROR Executable paths and parameters too long for a message queue message\n");
+            for (int e = 0; e < num_executables; e++) {
+                free(executable_paths[e]);
+            }
+            free(executable_paths);
+            executable_paths = NULL;
+        }
+    }
+
+    if (executable_paths != NULL) {
+        for (int e = 0; e < num_executables; e++) {
+            reply("EXE %s\n", executable_paths[e]);
+        }
+
+        // Relaunch the slots of workers that died
+        for (int w = 0; w < num_workers; w++) {
+            if (workers[w] == 0)
+                launch_worker(w);
+        }
+
+        // Split the pairs among the workers like mq_autograder, round robin in parameter order
+        int num_pairs = num_executables * num_params;
+        int used = num_workers < num_pairs ? num_workers : num_pairs;
+        pairs_init(&pairs, num_pairs);
+        int *assigned = malloc((num_pairs / (used > 0 ? used : 1) + 1) * sizeof(int));
+        for (int w = 0; w < used; w++) {
+            int n = 0;
+            for (int p = w; p < num_pairs; p += used) {
+                assigned[n++] = p;
+            }
+            assign_pairs(w, assigned, n);
+        }
+        free(assigned);
+
+        // Results of any worker until each is DONE (or dead with no one to take over)
+        for (;;) {
+            place_orphans();
+
+            int busy = 0;
+            for (int w = 0; w < num_workers; w++) {
+                busy += worker_pairs[w] > 0;
+            }
+            if (busy == 0) {
+                if (pairs.num_orphaned > 0)
+                    fprintf(stderr, "No workers left, %d pair(s) couldn't be tested\n", pairs.num_orphaned);
+                break;
+            }
+
+            msgbuf_t msg;
+            if (msgrcv(msqid, &msg, MESSAGE_SIZE, -num_workers, 0) == -1) {
+                if (errno != EINTR) {
+                    perror("Failed to receive results");
+                    exit(1);
+                }
+                check_workers();
+                continue;
+            }
+            handle_message(msg.mtype - 1, &msg);
+        }
+
+        // The outputs were only needed to read the status
+        for (int p = 0; expected_dir == NULL && p < num_pairs; p++) {
+            char label[PARAM_LABEL_MAX + 1], output_file[PATH_MAX];
+            int i = p / num_executables;
+            param_label(label, param_values[i], strlen(param_values[i]), i);
+            snprintf(output_file, sizeof(output_file), "output/%s.%s",
+                     get_exe_name(executable_paths[p % num_executables]), label);
+            unlink(output_file);
+        }
+
+        reply("END\n");
+        for (int e = 0; e < num_executables; e++) {
+            free(executable_paths[e]);
+        }
+        free(executable_paths);
+        executable_paths = NULL;
+        num_executables = 0;
+        pairs_free(&pairs);
+    }
+
+    for (int i = 0; i < num_params; i++) {
+        free(param_values[i]);
+    }
+    free(param_values);
+    free(testdir);
+    fclose(in);
+    if (client != NULL)
+        fclose(client);
+    client = NULL;
+}
+
+
+// Tell every worker to exit and wait for them
+void stop_workers() {
+    for (int w = 0; w < num_workers; w++) {
+        if (workers[w] != 0)
+            send_msg(PAIRS_MTYPE(w + 1), POOL_EXIT_MSG);
+    }
+    for (int w = 0; w < num_workers; w++) {
+        if (workers[w] != 0)
+            waitpid(workers[w], NULL, 0);
+        workers[w] = 0;
+    }
+}
+
+
+// The queue and socket go away however the pool exits
+void remove_queue() {
+    if (msqid != -1 && msgctl(msqid, IPC_RMID, NULL) == -1)
+        perror("Failed to remove message queue");
+    msqid = -1;
+    if (socket_path != NULL)
+        unlink(socket_path);
+}
+
+
+void stop_handler(int signum) {
+    pool_stop = 1;
+}
+
+
+// Interrupts accept() and msgrcv(), so the workers get checked
+static void wake_up(int signum) {
+}
+
+
+int main(int argc, char *argv[]) {
+    expected_dir = take_option(&argc, argv, "--expected");
+    compare_spec = take_option(&argc, argv, "--compare");
+    staging = take_flag(&argc, argv, "--stage");
+    contain_limits_from_args(&argc, argv);
+
+    if (argc < 2) {
+        printf("Usage: %s [--expected <dir> [--compare <mode>]] [--stage] [--mem-limit <size>] [--output-limit <size>] [--proc-limit <n>] <socket>\n", argv[0]);
+        return 1;
+    }
+
+    num_workers = get_batch_size();
+    workers = calloc(num_workers, sizeof(pid_t));
+    worker_pairs = calloc(num_workers, sizeof(int));
+    worker_heard_at = calloc(num_workers, sizeof(long long));
+
+    msqid = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+    if (msqid == -1) {
+        perror("Failed to create message queue");
+        exit(1);
+    }
+    int listen_fd = pool_listen(argv[1]);
+    socket_path = argv[1];
+    atexit(remove_queue);
+
+    // No SA_RESTART: a signal interrupts accept()/msgrcv() so it gets handled
+    struct sigaction sa = {0};
+    sa.sa_handler = stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = wake_up;
+    sigaction(SIGCHLD, &sa, NULL);
+    sigaction(SIGALRM, &sa, NULL);
+    sigemptyset(&check_signals);
+    sigaddset(&check_signals, SIGCHLD);
+    sigaddset(&check_signals, SIGALRM);
+    signal(SIGPIPE, SIG_IGN);
+    struct itimerval check = { { WORKER_CHECK_SECS, 0 }, { WORKER_CHECK_SECS, 0 } };
+    setitimer(ITIMER_REAL, &check, NULL);
+
+    // Whatever a worker that dies leaves running comes back to us (see contain.h)
+    contain_supervise();
+
+    for (int w = 0; w < num_workers; w++) {
+        launch_worker(w);
+    }
+    printf("Pool of %d workers listening on %s\n", num_workers, socket_path);
+    fflush(stdout);
+
+    // One job at a time, in the order they connect
+    while (!pool_stop) {
+        int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn == -1) {
+            if (errno != EINTR) {
+                perror("Failed to accept job");
+                exit(1);
+            }
+            check_workers();
+            continue;
+        }
+        run_job(conn);
+    }
+
+    close(listen_fd);
+    stop_workers();
+    remove_queue();
+    free(workers);
+    free(worker_pairs);
+    free(worker_heard_at);
+    printf("Pool stopped\n");
+    return 0;
+}
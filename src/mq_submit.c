@@ -0,0 +1,134 @@
+#include "utils.h"
+#include "pool.h"
+#include "delta.h"
+#include <sys/socket.h>
+
+// Stores the results of the job (see utils.h for details)
+autograder_results_t *results;
+int num_executables;
+
+
+// Add the executable of an EXE line to results
+void add_executable(char *path) {
+    results = realloc(results, (num_executables + 1) * sizeof(autograder_results_t));
+    results[num_executables].exe_path = strdup(path);
+    results[num_executables].status = NULL;
+    num_executables++;
+}
+
+
+int main(int argc, char *argv[]) {
+    char *delta_path = take_option(&argc, argv, "--delta");
+    param_source_t *params = param_source_from_args(&argc, argv, 3);
+
+    if (argc < 3 || params->count == 0) {
+        printf("Usage: %s [--delta <file>] <socket> <testdir> <p1> <p2> ... <pn>\n", argv[0]);
+        printf("       %s <socket> <testdir> --params-file <file> | --params-range <a>..<b>[:<step>]"
+               " | --params-random <n>:<lo>..<hi>[@<seed>]\n", argv[0]);
+        return 1;
+    }
+
+    // The pool runs somewhere else -> it gets the absolute path
+    char testdir[PATH_MAX];
+    if (realpath(argv[2], testdir) == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    long long start = get_time_us();
+    int fd = pool_connect(argv[1]);
+    FILE *pool = fdopen(fd, "r+");
+
+    // The request (see pool.h), keeping the labels to print the results with
+    int total_params = params->count;
+    char (*labels)[PARAM_LABEL_MAX + 1] = malloc(total_params * sizeof(*labels));
+    fprintf(pool, "%s%c%d%c", testdir, '\0', total_params, '\0');
+    char *param;
+    int param_len;
+    for (int i = 0; (param = param_source_next(params, &param_len)) != NULL; i++) {
+        fwrite(param, 1, param_len + 1, pool);
+        param_label(labels[i], param, param_len, i);
+    }
+    if (fflush(pool) == EOF) {
+        perror("Failed to submit job");
+        return 1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    // The answer, printing every result as it comes in
+    char *line = NULL;
+    size_t cap = 0;
+    int done = 0, received = 0;
+    long long first_result = 0;
+    while (getline(&line, &cap, pool) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+
+        if (strncmp(line, "EXE ", 4) == 0) {
+            add_executable(line + 4);
+        } else if (strncmp(line, "RESULT ", 7) == 0) {
+            char exe_path[PATH_MAX];
+            int param_idx, status;
+            long long duration_us;
+            if (sscanf(line + 7, "%s %d %d %lld", exe_path, &param_idx, &status, &duration_us) != 4
+                || param_idx < 0 || param_idx >= total_params) {
+                fprintf(stderr, "Malformed result: %s\n", line);
+                continue;
+            }
+            int e = 0;
+            while (e < num_executables && strcmp(results[e].exe_path, exe_path) != 0) {
+                e++;
+            }
+            if (e == num_executables)
+                continue;
+            if (results[e].status == NULL)
+                results[e].status = calloc(total_params, sizeof(int));   // "unknown" if never tested
+            results[e].status[param_idx] = status;
+
+            if (received++ == 0)
+                first_result = get_time_us();
+            printf("%s %s: %s (%.1f ms)\n", get_exe_name(exe_path), labels[param_idx],
+                   get_status_message(status), duration_us / 1e3);
+            fflush(stdout);
+        } else if (strcmp(line, "END") == 0) {
+            done = 1;
+            break;
+        } else if (strncmp(line, "ERROR ", 6) == 0) {
+            fprintf(stderr, "%s\n", line + 6);
+            return 1;
+        }
+    }
+    free(line);
+    fclose(pool);
+
+    if (!done) {
+        fprintf(stderr, "The pool went away before the job was done\n");
+        return 1;
+    }
+
+    for (int e = 0; e < num_executables; e++) {
+        if (results[e].status == NULL)
+            results[e].status = calloc(total_params, sizeof(int));
+    }
+    delta_t *delta = delta_path != NULL ? delta_begin(results_path, scores_path) : NULL;
+    write_results_to_file(results, num_executables, params);
+    write_scores_to_file(results, num_executables, results_path);
+    if (delta != NULL) {
+        FILE *delta_out = delta_open(delta_path);
+        printf("Delta: %d rows changed\n", delta_end(delta, delta_out));
+        fclose(delta_out);
+    }
+
+    printf("%d/%d pairs in %.3f s", received, num_executables * total_params, (get_time_us() - start) / 1e6);
+    if (received > 0)
+        printf(", first result after %.1f ms", (first_result - start) / 1e3);
+    printf("\n");
+
+    for (int e = 0; e < num_executables; e++) {
+        free(results[e].exe_path);
+        free(results[e].status);
+    }
+    free(results);
+    free(labels);
+    param_source_close(params);
+    return 0;
+}
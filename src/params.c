@@ -0,0 +1,157 @@
+#include "utils.h"
+#include "params.h"
+#include "hash.h"
+
+
+// Count the lines of a file in fixed-size chunks (a last line without '\n' counts too)
+static long count_lines(FILE *fp) {
+    char chunk[BUFSIZ];
+    long lines = 0;
+    size_t n;
+    int last = '\n';
+
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            if (chunk[i] == '\n')
+                lines++;
+        }
+        last = chunk[n - 1];
+    }
+    if (last != '\n')
+        lines++;
+
+    rewind(fp);
+    return lines;
+}
+
+
+param_source_t *param_source_from_args(int *argc, char **argv, int first_param) {
+    char *file = take_option(argc, argv, "--params-file");
+    char *range = take_option(argc, argv, "--params-range");
+    char *rand_spec = take_option(argc, argv, "--params-random");
+
+    if ((file != NULL) + (range != NULL) + (rand_spec != NULL) > 1) {
+        fprintf(stderr, "Only one of --params-file, --params-range, --params-random can be used\n");
+        exit(1);
+    }
+
+    param_source_t *src = calloc(1, sizeof(param_source_t));
+    src->buf_size = 32;
+    src->buf = malloc(src->buf_size);
+
+    if (file != NULL) {
+        src->kind = PARAM_FILE;
+        src->path = file;
+        src->fp = fopen(file, "r");
+        if (src->fp == NULL) {
+            perror("Failed to open parameter file");
+            exit(1);
+        }
+        src->count = count_lines(src->fp);
+    }
+    else if (range != NULL) {
+        long long end;
+        src->kind = PARAM_RANGE;
+        src->step = 1;
+        if (sscanf(range, "%lld..%lld:%lld", &src->start, &end, &src->step) < 2 || src->step <= 0) {
+            fprintf(stderr, "Bad parameter range '%s' (expected <start>..<end>[:<step>])\n", range);
+            exit(1);
+        }
+        src->count = end < src->start ? 0 : (end - src->start) / src->step + 1;
+    }
+    else if (rand_spec != NULL) {
+        src->kind = PARAM_RANDOM;
+        src->seed = 0;
+        if (sscanf(rand_spec, "%ld:%lld..%lld@%llu", &src->count, &src->lo, &src->hi, &src->seed) < 3
+            || src->hi < src->lo) {
+            fprintf(stderr, "Bad random parameters '%s' (expected <n>:<lo>..<hi>[@<seed>])\n", rand_spec);
+            exit(1);
+        }
+    }
+    else {
+        src->kind = PARAM_ARGV;
+        src->argv = argv + first_param;
+        src->count = *argc - first_param;
+    }
+
+    if (src->count < 0)
+        src->count = 0;
+
+    return src;
+}
+
+
+char *param_source_next(param_source_t *src, int *len) {
+    if (src->next >= src->count)
+        return NULL;
+
+    long idx = src->next++;
+
+    switch (src->kind) {
+        case PARAM_ARGV:
+            *len = strlen(src->argv[idx]);
+            return src->argv[idx];
+
+        case PARAM_FILE: {
+            ssize_t n = getline(&src->buf, &src->buf_size, src->fp);
+            if (n == -1) {
+                // File shrank since it was counted
+                src->next = src->count;
+                return NULL;
+            }
+            if (n > 0 && src->buf[n - 1] == '\n')
+                src->buf[--n] = '\0';
+            *len = n;
+            return src->buf;
+        }
+
+        case PARAM_RANGE:
+            *len = sprintf(src->buf, "%lld", src->start + idx * src->step);
+            return src->buf;
+
+        case PARAM_RANDOM: {
+            unsigned long long span = (unsigned long long) (src->hi - src->lo) + 1;
+            // A stateless mix of (seed, index), so sample i is the same on every pass
+            unsigned long long r = mix64(src->seed ^ mix64(idx));
+            *len = sprintf(src->buf, "%lld", src->lo + (long long) (span == 0 ? r : r % span));
+            return src->buf;
+        }
+    }
+    return NULL;
+}
+
+
+void param_source_rewind(param_source_t *src) {
+    src->next = 0;
+    if (src->kind == PARAM_FILE)
+        rewind(src->fp);
+}
+
+
+void param_source_close(param_source_t *src) {
+    if (src->fp != NULL)
+        fclose(src->fp);
+    free(src->buf);
+    free(src);
+}
+
+
+void param_label(char *label, const char *param, int len, long idx) {
+    int ok = len > 0 && len <= PARAM_LABEL_MAX;
+    for (int i = 0; ok && i < len; i++) {
+        char c = param[i];
+        ok = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+             || c == '-' || c == '+' || c == '_' || c == '.';
+    }
+
+    // "." and ".." would make odd file names
+    if (ok && param[0] == '.')
+        ok = 0;
+
+    if (ok) {
+        memcpy(label, param, len);
+        label[len] = '\0';
+    } else {
+        sprintf(label, "#%ld", idx + 1);
+    }
+}
@@ -0,0 +1,52 @@
+#include "utils.h"
+#include "policy.h"
+
+int fail_fast;              // --fail-fast
+double pass_threshold;      // --pass-threshold, 0 if off
+int max_crashes;            // --max-crashes, 0 if off
+
+
+void policy_from_args(int *argc, char **argv) {
+    fail_fast = take_flag(argc, argv, "--fail-fast");
+    char *threshold = take_option(argc, argv, "--pass-threshold");
+    char *crashes = take_option(argc, argv, "--max-crashes");
+
+    if (threshold != NULL) {
+        char *end;
+        pass_threshold = strtod(threshold, &end);
+        if (*end == '%') {
+            pass_threshold /= 100;
+            end++;
+        }
+        if (end == threshold || *end != '\0' || pass_threshold <= 0 || pass_threshold > 1) {
+            fprintf(stderr, "Bad threshold '%s' for --pass-threshold\n", threshold);
+            exit(1);
+        }
+    }
+    if (crashes != NULL && (max_crashes = atoi(crashes)) <= 0) {
+        fprintf(stderr, "Bad crash count '%s' for --max-crashes\n", crashes);
+        exit(1);
+    }
+}
+
+
+void policy_record(policy_tally_t *tally, int status) {
+    if (status == SKIPPED)
+        return;
+    tally->tested++;
+    tally->failed += status != CORRECT;
+    tally->crashes += status == SEGFAULT;
+}
+
+
+int policy_decided(const policy_tally_t *tally, int total_params) {
+    if (fail_fast && tally->failed > 0)
+        return 1;
+    if (max_crashes > 0 && tally->crashes >= max_crashes)
+        return 1;
+
+    // Best score left: every remaining parameter correct (a little slack for 0.8 * n)
+    if (pass_threshold > 0 && total_params - tally->failed < pass_threshold * total_params - 1e-9)
+        return 1;
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "utils.h"
+#include "pool.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+// Address of the socket at path, exit if it is too long
+static void socket_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Pool socket path too long: %s\n", path);
+        exit(1);
+    }
+    strcpy(addr->sun_path, path);
+}
+
+
+int pool_listen(const char *path) {
+    struct sockaddr_un addr;
+    socket_address(&addr, path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) {
+        perror("Failed to create pool socket");
+        exit(1);
+    }
+
+    // Replace a stale socket left behind by a pool that was killed
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(listen_fd, 16) == -1) {
+        perror("Failed to listen on pool socket");
+        exit(1);
+    }
+    return listen_fd;
+}
+
+
+int pool_connect(const char *path) {
+    struct sockaddr_un addr;
+    socket_address(&addr, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Failed to create socket");
+        exit(1);
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        perror(path);
+        exit(1);
+    }
+    return fd;
+}
+
+
+long pool_read_string(FILE *fp, char **buf, size_t *cap) {
+    ssize_t len = getdelim(buf, cap, '\0', fp);
+    if (len <= 0 || (*buf)[len - 1] != '\0')
+        return -1;
+    return len - 1;
+}
@@ -0,0 +1,250 @@
+#include "utils.h"
+#include "profile.h"
+#include <sys/shm.h>
+
+profile_t *profile = NULL;
+
+int profile_shm_id = -1;        // Shared memory segment holding the histograms
+int profile_owner;              // 1 in the process that created it
+
+static const char *phase_names[PROFILE_PHASES] = {
+    "spawn", "exec", "run", "harvest", "evaluate", "store", "release", "report", "deliver"
+};
+
+// Children of the current batch (see profile_batch())
+pid_t *batch_pids;
+volatile int batch_n;
+volatile long long *exited_at;    // When each child's exit was noticed, 0 until then
+long long *exec_done_at;          // When each child's program started running
+int slots_allocated;
+int sigchld_installed;
+
+#define SUB_BUCKETS (1 << PROFILE_SUB_BITS)
+
+
+static int bucket_of(unsigned long long v) {
+    if (v < SUB_BUCKETS)
+        return v;
+    int e = 63 - __builtin_clzll(v);
+    int sub = (v >> (e - PROFILE_SUB_BITS)) - SUB_BUCKETS;
+    return (e - PROFILE_SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+
+// Largest value that falls into bucket b
+static long long bucket_high(int b) {
+    if (b < SUB_BUCKETS)
+        return b;
+    int shift = b / SUB_BUCKETS - 1;
+    return ((long long) (SUB_BUCKETS + b % SUB_BUCKETS + 1) << shift) - 1;
+}
+
+
+void profile_start() {
+    profile_shm_id = shmget(IPC_PRIVATE, sizeof(profile_t), IPC_CREAT | 0600);
+    if (profile_shm_id == -1) {
+        perror("Failed to create profile shared memory");
+        exit(1);
+    }
+    profile_attach(profile_shm_id);
+    memset(profile, 0, sizeof(profile_t));
+    profile_owner = 1;
+}
+
+
+void profile_attach(int shmid) {
+    profile = shmat(shmid, NULL, 0);
+    if (profile == (void *) -1) {
+        perror("Failed to attach profile shared memory");
+        exit(1);
+    }
+    profile_shm_id = shmid;
+}
+
+
+int profile_shmid() {
+    return profile_shm_id;
+}
+
+
+long long profile_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+void profile_record(int phase, long long ns) {
+    if (!PROFILE_ON)
+        return;
+    if (ns < 0)
+        ns = 0;
+
+    profile_hist_t *hist = &profile->phases[phase];
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->buckets[bucket_of(ns)], 1, __ATOMIC_RELAXED);
+
+    long max = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&hist->max_ns, &max, ns, 1,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+
+long long profile_since(int phase, long long start) {
+    if (!PROFILE_ON)
+        return 0;
+    long long now = profile_now();
+    profile_record(phase, now - start);
+    return now;
+}
+
+
+// Note the exit of every child of the batch that has exited but hasn't been
+// noticed yet, without reaping it
+static void sigchld_handler(int signum) {
+    int saved_errno = errno;
+    long long now = profile_now();
+
+    for (int j = 0; j < batch_n; j++) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (exited_at[j] == 0 && batch_pids[j] > 0
+            && waitid(P_PID, batch_pids[j], &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid != 0)
+            exited_at[j] = now;
+    }
+    errno = saved_errno;
+}
+
+
+void profile_batch(pid_t *pids, int n) {
+    if (!PROFILE_ON)
+        return;
+
+    if (!sigchld_installed) {
+        struct sigaction sa = {0};
+        sa.sa_handler = sigchld_handler;
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGCHLD, &sa, NULL);
+        sigchld_installed = 1;
+    }
+
+    // No SIGCHLD looks at the slots while they change
+    batch_n = 0;
+    if (n > slots_allocated) {
+        exited_at = realloc((void *) exited_at, n * sizeof(long long));
+        exec_done_at = realloc(exec_done_at, n * sizeof(long long));
+        slots_allocated = n;
+    }
+    for (int j = 0; j < n; j++) {
+        pids[j] = 0;
+        exited_at[j] = 0;
+        exec_done_at[j] = 0;
+    }
+    batch_pids = pids;
+    batch_n = n;
+}
+
+
+void profile_exec_pipe(int fds[2]) {
+    fds[0] = fds[1] = -1;
+    if (PROFILE_ON && pipe2(fds, O_CLOEXEC) == -1) {
+        perror("couldn't create exec handshake pipe");
+        exit(1);
+    }
+}
+
+
+void profile_exec_begin(int fds[2]) {
+    if (fds[1] == -1)
+        return;
+    long long now = profile_now();
+    write(fds[1], &now, sizeof(now));
+}
+
+
+void profile_spawned(int slot, int fds[2], long long spawn_start) {
+    if (fds[0] == -1)
+        return;
+    profile_record(PROFILE_SPAWN, profile_now() - spawn_start);
+
+    // The write end closes when exec() succeeds (or the child exits)
+    close(fds[1]);
+    long long exec_start = 0;
+    ssize_t n;
+    while ((n = read(fds[0], &exec_start, sizeof(exec_start))) == -1 && errno == EINTR) {
+    }
+    char c;
+    while (n == sizeof(exec_start) && (read(fds[0], &c, 1) == -1 && errno == EINTR)) {
+    }
+    long long now = profile_now();
+    close(fds[0]);
+
+    exec_done_at[slot] = now;
+    if (n == sizeof(exec_start))
+        profile_record(PROFILE_EXEC, now - exec_start);
+}
+
+
+long long profile_reaped(int slot) {
+    if (!PROFILE_ON)
+        return 0;
+    long long now = profile_now();
+
+    // A child reaped before its SIGCHLD was handled exited just now
+    long long exited = exited_at[slot] != 0 ? exited_at[slot] : now;
+    if (exec_done_at[slot] != 0)
+        profile_record(PROFILE_RUN, exited - exec_done_at[slot]);
+    profile_record(PROFILE_HARVEST, now - exited);
+    return now;
+}
+
+
+// Smallest value that at least fraction q of the values in hist are at most
+static long long percentile(profile_hist_t *hist, double q) {
+    long target = (long) (q * hist->count + 0.999999);
+    long seen = 0;
+    for (int b = 0; b < PROFILE_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= target && seen > 0)
+            return bucket_high(b) < hist->max_ns ? bucket_high(b) : hist->max_ns;
+    }
+    return hist->max_ns;
+}
+
+
+void profile_stop(FILE *fp) {
+    if (!PROFILE_ON)
+        return;
+
+    if (fp != NULL) {
+        fprintf(fp, "%-10s %9s %11s %11s %11s %11s %11s\n", "phase (us)", "count", "mean", "p50", "p90", "p99", "max");
+        double overhead_ns = 0, total_ns = 0;
+        for (int p = 0; p < PROFILE_PHASES; p++) {
+            profile_hist_t *hist = &profile->phases[p];
+            if (hist->count == 0)
+                continue;
+            fprintf(fp, "%-10s %9ld %11.1f %11.1f %11.1f %11.1f %11.1f\n", phase_names[p], hist->count,
+                    hist->sum_ns / 1e3 / hist->count, percentile(hist, 0.5) / 1e3, percentile(hist, 0.9) / 1e3,
+                    percentile(hist, 0.99) / 1e3, hist->max_ns / 1e3);
+            total_ns += hist->sum_ns;
+            if (p != PROFILE_RUN)
+                overhead_ns += hist->sum_ns;
+        }
+        if (total_ns > 0)
+            fprintf(fp, "Grader overhead: %.1f%% of the pairs' wall time\n", 100 * overhead_ns / total_ns);
+    }
+
+    if (sigchld_installed)
+        signal(SIGCHLD, SIG_DFL);
+    free((void *) exited_at);
+    free(exec_done_at);
+    exited_at = NULL;
+    exec_done_at = NULL;
+    slots_allocated = 0;
+    if (profile_owner)
+        shmctl(profile_shm_id, IPC_RMID, NULL);
+    shmdt(profile);
+    profile = NULL;
+}
@@ -0,0 +1,100 @@
+#include "progress.h"
+#include "hash.h"
+#include <math.h>
+
+// z of a two-sided 95% interval
+#define PROGRESS_Z 1.96
+
+
+int progress_plan(int n, int *order, int *round_ends) {
+    char *chosen = calloc(n, 1);
+    int count = 0, rounds = 0;
+
+    for (long strata = (n + PROGRESS_FIRST_FRACTION - 1) / PROGRESS_FIRST_FRACTION; strata < n; strata *= 2) {
+        for (long s = 0; s < strata; s++) {
+            // Stratum s is [lo, hi); draw from it unless it already has a parameter
+            long lo = s * n / strata, hi = (s + 1) * n / strata;
+            long k = lo;
+            while (k < hi && !chosen[k]) {
+                k++;
+            }
+            if (k < hi || lo == hi)
+                continue;
+
+            // Not rand_r(): its low bits are too regular to draw from strata whose width
+            // is a power of two
+            unsigned long long draw = mix64(PROGRESS_SEED ^ mix64((unsigned long long) strata << 32 | s));
+            long pick = lo + draw % (hi - lo);
+            chosen[pick] = 1;
+            order[count++] = pick;
+        }
+        if (count > (rounds > 0 ? round_ends[rounds - 1] : 0))
+            round_ends[rounds++] = count;
+    }
+
+    // Last round: the rest, in order
+    for (int i = 0; i < n; i++) {
+        if (!chosen[i])
+            order[count++] = i;
+    }
+    round_ends[rounds++] = n;
+
+    free(chosen);
+    return rounds;
+}
+
+
+// Score of results->status over the tested parameters, and its interval
+static double provisional_score(autograder_results_t *result, const int *order, int num_tested,
+                                int total_params, double *low, double *high) {
+    int correct = 0;
+    for (int k = 0; k < num_tested; k++) {
+        correct += result->status[order[k]] == CORRECT;
+    }
+
+    double m = num_tested, p = correct / m, z = PROGRESS_Z;
+
+    // Wilson score interval of a sample of m ...
+    double center = (p + z * z / (2 * m)) / (1 + z * z / m);
+    double half = z / (1 + z * z / m) * sqrt(p * (1 - p) / m + z * z / (4 * m * m));
+
+    // ... drawn without replacement from total_params
+    double fpc = total_params > 1 ? sqrt((total_params - m) / (total_params - 1)) : 0;
+    center = p + (center - p) * fpc;
+    half *= fpc;
+
+    *low = center - half > 0 ? center - half : 0;
+    *high = center + half < 1 ? center + half : 1;
+    return p;
+}
+
+
+void progress_write_scores(autograder_results_t *results, int num_executables, const int *order,
+                           int num_tested, int total_params) {
+    char score_file[PATH_MAX];
+    snprintf(score_file, sizeof(score_file), "%s.tmp", scores_path);
+    FILE *score_fp = fopen(score_file, "w");
+    if (!score_fp) {
+        perror("Failed to open score file");
+        exit(1);
+    }
+
+    int longest_len = get_longest_len_executable(results, num_executables);
+
+    // In the order of results.txt
+    int *rows = results_row_order(results, num_executables);
+    for (int k = 0; k < num_executables; k++) {
+        int i = rows[k];
+        double low, high;
+        double score = provisional_score(&results[i], order, num_tested, total_params, &low, &high);
+
+        char format[20];
+        sprintf(format, "%%-%ds: ", longest_len);
+        fprintf(score_fp, format, get_exe_name(results[i].exe_path));
+        fprintf(score_fp, "%5.3f [%5.3f, %5.3f] %d/%d\n", score, low, high, num_tested, total_params);
+    }
+    free(rows);
+
+    if (fclose(score_fp) != 0 || rename(score_file, scores_path) == -1)
+        perror(scores_path);
+}
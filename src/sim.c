@@ -0,0 +1,380 @@
+#include "utils.h"
+#include "history.h"
+#include "sim.h"
+#include "hash.h"
+#include <math.h>
+
+int sim_on;
+history_t *sim_trace;           // Recorded trace, NULL for a synthetic one
+int sim_num_synthetic;          // Executables of a synthetic trace
+unsigned long long sim_seed;
+long long sim_clock;            // Virtual time (us)
+
+// A pair as it ran (see sim_record())
+typedef struct {
+    long long duration_us;
+    long long timeout_us;
+    int stuck;
+} sim_run_t;
+
+sim_run_t *sim_runs;
+long num_sim_runs, sim_runs_capacity;
+
+
+// Uniform in (0, 1) and standard normal (Box-Muller) values drawn from hash
+static double unit(unsigned long long hash) {
+    return ((hash >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double normal(unsigned long long hash) {
+    return sqrt(-2 * log(unit(mix64(hash)))) * cos(2 * M_PI * unit(mix64(hash ^ 1)));
+}
+
+
+void sim_open(const char *spec) {
+    sim_on = 1;
+    if (strncmp(spec, "synthetic:", 10) == 0) {
+        if (sscanf(spec + 10, "%d@%llu", &sim_num_synthetic, &sim_seed) < 1 || sim_num_synthetic <= 0) {
+            fprintf(stderr, "Bad trace '%s' (expected <history file> or synthetic:<n>[@<seed>])\n", spec);
+            exit(1);
+        }
+        return;
+    }
+
+    sim_trace = history_load(spec);
+    if (sim_trace->entries.count == 0) {
+        fprintf(stderr, "Trace %s has no pairs\n", spec);
+        exit(1);
+    }
+}
+
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+
+char **sim_executables(char *testdir, int *num_executables) {
+    char **names;
+    int n = 0;
+    if (sim_trace == NULL) {
+        names = malloc(sim_num_synthetic * sizeof(char *));
+        for (n = 0; n < sim_num_synthetic; n++) {
+            char name[32];
+            sprintf(name, "sol_%d", n + 1);
+            names[n] = strdup(name);
+        }
+    } else {
+        // Every executable the trace has a pair of, once
+        names = malloc(sim_trace->entries.count * sizeof(char *));
+        for (long i = 0; i < sim_trace->entries.capacity; i++) {
+            history_entry_t *entry = hash_table_slot(&sim_trace->entries, i);
+            if (entry != NULL)
+                names[n++] = entry->exe;
+        }
+        qsort(names, n, sizeof(char *), compare_names);
+        int unique = 0;
+        for (int k = 0; k < n; k++) {
+            if (unique == 0 || strcmp(names[unique - 1], names[k]) != 0)
+                names[unique++] = names[k];
+        }
+        n = unique;
+        for (int k = 0; k < n; k++) {
+            names[k] = strdup(names[k]);
+        }
+    }
+
+    // Same paths as get_student_executables() would have
+    char **paths = malloc(n * sizeof(char *));
+    for (int k = 0; k < n; k++) {
+        paths[k] = malloc(strlen(testdir) + strlen(names[k]) + 2);
+        sprintf(paths[k], "%s/%s", testdir, names[k]);
+        free(names[k]);
+    }
+    free(names);
+
+    *num_executables = n;
+    return paths;
+}
+
+
+void sim_pair(const char *exe, const char *label, int *status, long long *duration_us) {
+    history_entry_t *entry = sim_trace != NULL ? history_lookup(sim_trace, exe, label) : NULL;
+    if (entry != NULL) {
+        *status = entry->status;
+        *duration_us = entry->duration_us;
+        return;
+    }
+
+    // Made up from (seed, exe) for the executable and (seed, exe, label) for the pair
+    unsigned long long exe_hash = mix64(sim_seed ^ hash_string(FNV_OFFSET, exe));
+    double correct_share = 0.2 + 0.8 * unit(mix64(exe_hash ^ 1));
+    double typical_us = SIM_MEDIAN_US * exp(0.7 * normal(exe_hash ^ 2));
+
+    unsigned long long pair_hash = mix64(exe_hash ^ hash_string(FNV_OFFSET, label));
+    double u = unit(mix64(pair_hash ^ 3));
+    double v = (u - correct_share) / (1 - correct_share);
+    *status = u < correct_share ? CORRECT : v < 0.7 ? INCORRECT : v < 0.9 ? SEGFAULT : STUCK_OR_INFINITE;
+    *duration_us = (long long) (typical_us * exp(0.5 * normal(pair_hash ^ 4)));
+}
+
+
+void sim_record(long long duration_us, int stuck, long long timeout_us) {
+    if (num_sim_runs == sim_runs_capacity) {
+        sim_runs_capacity = sim_runs_capacity == 0 ? 1024 : 2 * sim_runs_capacity;
+        sim_runs = realloc(sim_runs, sim_runs_capacity * sizeof(sim_run_t));
+    }
+    sim_runs[num_sim_runs].duration_us = duration_us;
+    sim_runs[num_sim_runs].timeout_us = timeout_us;
+    sim_runs[num_sim_runs].stuck = stuck;
+    num_sim_runs++;
+}
+
+
+long long sim_now() {
+    return sim_clock;
+}
+
+
+void sim_advance(long long us) {
+    sim_clock += us;
+}
+
+
+/*
+Processor sharing of cores among the running pairs: while n pairs run, each
+gets min(1, cores / n) of a core. Instead of updating every pair, the service
+a pair running all along would have had is tracked, and a pair is done when
+that reaches its start value plus its run time. Pairs are also killed at their
+deadline (wall time). Both kinds of events are kept in binary heaps, and
+entries of pairs that already ended are skipped when they come up.
+*/
+typedef struct {
+    double key;
+    long id;
+} heap_entry_t;
+
+typedef struct {
+    heap_entry_t *entries;
+    long size;
+} heap_t;
+
+typedef struct {
+    int cores;
+    int running;
+    double now;                 // Wall time (us)
+    double service;             // Service of a pair running since time 0 (us)
+    heap_t done_at;             // Keyed by service
+    heap_t deadline;            // Keyed by wall time
+    char *alive;                // Per pair, 1 while it runs
+} ps_t;
+
+
+static void heap_push(heap_t *heap, double key, long id) {
+    long i = heap->size++;
+    while (i > 0 && heap->entries[(i - 1) / 2].key > key) {
+        heap->entries[i] = heap->entries[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->entries[i].key = key;
+    heap->entries[i].id = id;
+}
+
+
+static heap_entry_t heap_pop(heap_t *heap) {
+    heap_entry_t top = heap->entries[0], last = heap->entries[--heap->size];
+    long i = 0;
+    for (;;) {
+        long child = 2 * i + 1;
+        if (child >= heap->size)
+            break;
+        if (child + 1 < heap->size && heap->entries[child + 1].key < heap->entries[child].key)
+            child++;
+        if (heap->entries[child].key >= last.key)
+            break;
+        heap->entries[i] = heap->entries[child];
+        i = child;
+    }
+    if (heap->size > 0)
+        heap->entries[i] = last;
+    return top;
+}
+
+
+static void ps_init(ps_t *ps, int cores) {
+    memset(ps, 0, sizeof(ps_t));
+    ps->cores = cores;
+    ps->done_at.entries = malloc(num_sim_runs * sizeof(heap_entry_t));
+    ps->deadline.entries = malloc(num_sim_runs * sizeof(heap_entry_t));
+    ps->alive = calloc(num_sim_runs, 1);
+}
+
+
+static void ps_free(ps_t *ps) {
+    free(ps->done_at.entries);
+    free(ps->deadline.entries);
+    free(ps->alive);
+}
+
+
+// Start pair id now, to be killed at deadline (wall time) unless done before
+static void ps_start(ps_t *ps, long id, double deadline) {
+    if (!sim_runs[id].stuck)
+        heap_push(&ps->done_at, ps->service + sim_runs[id].duration_us, id);
+    heap_push(&ps->deadline, deadline, id);
+    ps->alive[id] = 1;
+    ps->running++;
+}
+
+
+// Advance to the next pair that ends, and return it (-1 if none runs)
+static long ps_next(ps_t *ps) {
+    while (ps->done_at.size > 0 && !ps->alive[ps->done_at.entries[0].id]) {
+        heap_pop(&ps->done_at);
+    }
+    while (ps->deadline.size > 0 && !ps->alive[ps->deadline.entries[0].id]) {
+        heap_pop(&ps->deadline);
+    }
+    if (ps->running == 0)
+        return -1;
+
+    double rate = ps->running <= ps->cores ? 1 : (double) ps->cores / ps->running;
+    double done = ps->done_at.size > 0 ? ps->now + (ps->done_at.entries[0].key - ps->service) / rate : INFINITY;
+    double killed = ps->deadline.size > 0 ? ps->deadline.entries[0].key : INFINITY;
+
+    heap_entry_t next;
+    if (done <= killed) {
+        next = heap_pop(&ps->done_at);
+        ps->service = next.key;
+        ps->now = done;
+    } else {
+        next = heap_pop(&ps->deadline);
+        ps->service += (killed - ps->now) * rate;
+        ps->now = killed;
+    }
+    ps->alive[next.id] = 0;
+    ps->running--;
+    return next.id;
+}
+
+
+// Makespan with batch_size slots that each start the next pair when theirs is done
+static double makespan_window(int batch_size) {
+    ps_t ps;
+    ps_init(&ps, batch_size);
+
+    long next = 0;
+    for (; next < num_sim_runs && next < batch_size; next++) {
+        ps_start(&ps, next, ps.now + sim_runs[next].timeout_us);
+    }
+    while (ps_next(&ps) != -1) {
+        if (next < num_sim_runs) {
+            ps_start(&ps, next, ps.now + sim_runs[next].timeout_us);
+            next++;
+        }
+    }
+
+    double makespan = ps.now;
+    ps_free(&ps);
+    return makespan;
+}
+
+
+// Workers of the mq and steal policies; worker w's queue is queue[w][head[w]..tail[w]-1]
+typedef struct {
+    int num_workers;
+    int steal;
+    long **queue;
+    long *head, *tail;
+    int *left;                  // Children of the worker's batch still running
+    int *owner;                 // Per pair, the worker that ran it
+} workers_t;
+
+
+// Start worker w's next batch, stealing first if its queue is empty
+static void start_batch(workers_t *workers, ps_t *ps, int w) {
+    long *head = workers->head, *tail = workers->tail;
+    if (workers->steal && head[w] == tail[w]) {
+        int victim = 0;
+        for (int v = 1; v < workers->num_workers; v++) {
+            if (tail[v] - head[v] > tail[victim] - head[victim])
+                victim = v;
+        }
+        long take = (tail[victim] - head[victim] + 1) / 2;
+        head[w] = tail[w] = 0;
+        for (long k = tail[victim] - take; k < tail[victim]; k++) {
+            workers->queue[w][tail[w]++] = workers->queue[victim][k];
+        }
+        tail[victim] -= take;
+    }
+
+    for (int j = 0; j < PAIRS_BATCH_SIZE && head[w] < tail[w]; j++) {
+        long p = workers->queue[w][head[w]++];
+        workers->owner[p] = w;
+        workers->left[w]++;
+        ps_start(ps, p, ps->now + sim_runs[p].timeout_us);
+    }
+}
+
+
+// Makespan of mq_autograder with batch_size workers (and cores), stealing or not
+static double makespan_workers(int batch_size, int steal) {
+    workers_t workers;
+    workers.num_workers = batch_size;
+    workers.steal = steal;
+    workers.queue = malloc(batch_size * sizeof(long *));
+    workers.head = calloc(batch_size, sizeof(long));
+    workers.tail = calloc(batch_size, sizeof(long));
+    workers.left = calloc(batch_size, sizeof(int));
+    workers.owner = malloc(num_sim_runs * sizeof(int));
+    for (int w = 0; w < batch_size; w++) {
+        workers.queue[w] = malloc(num_sim_runs * sizeof(long));
+    }
+    for (long p = 0; p < num_sim_runs; p++) {
+        int w = p % batch_size;
+        workers.queue[w][workers.tail[w]++] = p;
+    }
+
+    ps_t ps;
+    ps_init(&ps, batch_size);
+    for (int w = 0; w < batch_size; w++) {
+        start_batch(&workers, &ps, w);
+    }
+    long p;
+    while ((p = ps_next(&ps)) != -1) {
+        if (--workers.left[workers.owner[p]] == 0)
+            start_batch(&workers, &ps, workers.owner[p]);
+    }
+
+    double makespan = ps.now;
+    for (int w = 0; w < batch_size; w++) {
+        free(workers.queue[w]);
+    }
+    free(workers.queue);
+    free(workers.head);
+    free(workers.tail);
+    free(workers.left);
+    free(workers.owner);
+    ps_free(&ps);
+    return makespan;
+}
+
+
+void sim_report(FILE *fp, int batch_size) {
+    fprintf(fp, "Simulated makespan of the %ld pairs by dispatch policy:\n", num_sim_runs);
+    fprintf(fp, "    batch    %10.2f s  (as run)\n", sim_clock / 1e6);
+    fprintf(fp, "    window   %10.2f s\n", makespan_window(batch_size) / 1e6);
+    fprintf(fp, "    mq       %10.2f s\n", makespan_workers(batch_size, 0) / 1e6);
+    fprintf(fp, "    steal    %10.2f s\n", makespan_workers(batch_size, 1) / 1e6);
+}
+
+
+void sim_close() {
+    if (sim_trace != NULL)
+        history_free(sim_trace);
+    sim_trace = NULL;
+    free(sim_runs);
+    sim_runs = NULL;
+    num_sim_runs = sim_runs_capacity = 0;
+    sim_on = 0;
+}
@@ -0,0 +1,164 @@
+#include "utils.h"
+#include "stage.h"
+#include "hash.h"
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
+
+// One executable, with the stat() it was staged from
+typedef struct {
+    char *path;             // The key
+    int fd;                 // Sealed memfd, -1 if the executable runs from its path
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+} staged_t;
+
+hash_table_t staged;        // staged_t on path, capacity 0 while staging is off
+
+
+static int same_file(const staged_t *entry, const struct stat *st) {
+    return entry->dev == st->st_dev && entry->ino == st->st_ino && entry->size == st->st_size
+           && entry->mtime.tv_sec == st->st_mtim.tv_sec && entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+
+static int create_memfd(const char *name) {
+    #ifdef MFD_EXEC
+        // Kernels with vm.memfd_noexec want executable memfds asked for explicitly
+        int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_EXEC);
+        if (fd != -1 || errno != EINVAL)
+            return fd;
+    #endif
+    return memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+}
+
+
+// Copy the executable open as src_fd (size bytes) into a new sealed memfd, -1 on failure
+static int copy_to_memfd(int src_fd, off_t size, const char *name) {
+    int fd = create_memfd(name);
+    if (fd == -1)
+        return -1;
+
+    off_t off = 0;
+    while (off < size) {
+        ssize_t n = sendfile(fd, src_fd, &off, size - off);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    // Nothing can change the staged copy from now on
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+// Stage the executable at path, recording the stat() it was staged from in entry (all
+// but its path). Returns -1 on failure, so the next stage_fd() tries again.
+static int stage(staged_t *entry, char *path) {
+    entry->fd = -1;
+
+    int src_fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat before, after;
+    if (src_fd == -1 || fstat(src_fd, &before) == -1) {
+        if (src_fd != -1)
+            close(src_fd);
+        return -1;
+    }
+
+    char magic[2];
+    int script = pread(src_fd, magic, 2, 0) == 2 && magic[0] == '#' && magic[1] == '!';
+    if (!script) {
+        entry->fd = copy_to_memfd(src_fd, before.st_size, get_exe_name(path));
+
+        // Written to while we copied -> try again next time
+        if (entry->fd != -1 && (fstat(src_fd, &after) == -1 || after.st_size != before.st_size
+                                || after.st_mtim.tv_sec != before.st_mtim.tv_sec
+                                || after.st_mtim.tv_nsec != before.st_mtim.tv_nsec)) {
+            close(entry->fd);
+            entry->fd = -1;
+        }
+    }
+    close(src_fd);
+
+    if (entry->fd == -1 && !script)
+        return -1;
+
+    entry->dev = before.st_dev;
+    entry->ino = before.st_ino;
+    entry->size = before.st_size;
+    entry->mtime = before.st_mtim;
+    return 0;
+}
+
+
+void stage_init(char **paths, int n) {
+    if (staged.capacity == 0)
+        hash_table_init(&staged, sizeof(staged_t), 1, 1024);
+
+    // One memfd per executable
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    for (int i = 0; i < n; i++) {
+        int fd = open(paths[i], O_RDONLY | O_CLOEXEC);
+        if (fd != -1) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            close(fd);
+        }
+    }
+}
+
+
+int stage_fd(char *path) {
+    if (staged.capacity == 0)
+        return -1;
+
+    struct stat st;
+    if (stat(path, &st) == -1)
+        return -1;      // Let exec() report it
+
+    staged_t *entry = hash_table_find(&staged, path, NULL);
+    if (entry != NULL && same_file(entry, &st))
+        return entry->fd;
+
+    if (entry != NULL && entry->fd != -1) {
+        close(entry->fd);
+        entry->fd = -1;
+    }
+    staged_t fresh;
+    if (stage(&fresh, path) == -1)
+        return -1;
+
+    entry = hash_table_insert(&staged, path, NULL);
+    fresh.path = entry->path;
+    *entry = fresh;
+    return entry->fd;
+}
+
+
+void stage_exec(int fd, char **argv) {
+    if (fd != -1)
+        fexecve(fd, argv, environ);
+}
+
+
+void stage_free() {
+    for (long i = 0; i < staged.capacity; i++) {
+        staged_t *entry = hash_table_slot(&staged, i);
+        if (entry != NULL && entry->fd != -1)
+            close(entry->fd);
+    }
+    hash_table_free(&staged);
+}
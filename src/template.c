@@ -45,15 +45,18 @@ int main(int argc, char *argv[]) {
     write(STDERR_FILENO, &fd, sizeof(fd));
     fprintf(stderr, "%d", fd);
 
-    if ((read(fd, &param, sizeof(param))) == -1) {
+    // The input is text of any length - the parameter is the first integer in it
+    FILE *input = fdopen(fd, "r");
+    if (input == NULL || fscanf(input, "%d", &param) != 1) {
         perror("pipe read");
         exit(1);
     }
     
-    close(fd);
+    fclose(input);
 
     #elif MQUEUE
 
+    param = atoi((char *) argv[1]);
 
     #endif
 
@@ -0,0 +1,125 @@
+#include "utils.h"
+#include "trace.h"
+
+int trace_fd = -1;
+
+#define TRACE_LINE_SIZE 1024
+
+
+void trace_open(const char *path, int truncate) {
+    int flags = O_WRONLY | O_CREAT | O_APPEND;
+    if (truncate)
+        flags |= O_TRUNC;
+
+    trace_fd = open(path, flags, 0666);
+    if (trace_fd == -1) {
+        perror("Failed to open trace file");
+        exit(1);
+    }
+
+    if (truncate && write(trace_fd, "[\n", 2) == -1) {
+        perror("Failed to write trace file");
+        exit(1);
+    }
+}
+
+
+void trace_close() {
+    if (!TRACE_ON)
+        return;
+
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+
+// Copy src into dst as the body of a JSON string (quotes and control chars escaped)
+static int json_escape(char *dst, int size, const char *src) {
+    int n = 0;
+    for (; *src != '\0' && n < size - 7; src++) {
+        unsigned char c = (unsigned char) *src;
+        if (c == '"' || c == '\\') {
+            dst[n++] = '\\';
+            dst[n++] = c;
+        } else if (c < 0x20) {
+            n += sprintf(dst + n, "\\u%04x", c);
+        } else {
+            dst[n++] = c;
+        }
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+
+// Write one event line with a single write() so concurrent appenders don't interleave
+static void trace_emit(const char *line, int len) {
+    if (write(trace_fd, line, len) == -1) {
+        perror("Failed to write trace event");
+        trace_close();
+    }
+}
+
+
+void trace_process_name(const char *name) {
+    if (!TRACE_ON)
+        return;
+
+    char esc[256];
+    json_escape(esc, sizeof(esc), name);
+
+    char line[TRACE_LINE_SIZE];
+    int len = snprintf(line, sizeof(line),
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"%s\"}},\n",
+        getpid(), esc);
+    trace_emit(line, len);
+}
+
+
+void trace_thread_name(int tid, const char *name) {
+    if (!TRACE_ON)
+        return;
+
+    char esc[256];
+    json_escape(esc, sizeof(esc), name);
+
+    char line[TRACE_LINE_SIZE];
+    int len = snprintf(line, sizeof(line),
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+        getpid(), tid, esc);
+    trace_emit(line, len);
+}
+
+
+void trace_span(const char *name, int tid, long long start_us, long long end_us,
+                const char *exe, const char *param) {
+    if (!TRACE_ON)
+        return;
+
+    char exe_esc[256], param_esc[256];
+    json_escape(exe_esc, sizeof(exe_esc), exe ? exe : "");
+    json_escape(param_esc, sizeof(param_esc), param ? param : "");
+
+    char line[TRACE_LINE_SIZE];
+    int len = snprintf(line, sizeof(line),
+        "{\"name\":\"%s\",\"cat\":\"grader\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d,"
+        "\"args\":{\"exe\":\"%s\",\"param\":\"%s\"}},\n",
+        name, start_us, end_us - start_us, getpid(), tid, exe_esc, param_esc);
+    trace_emit(line, len);
+}
+
+
+void trace_instant(const char *name, int tid, const char *detail) {
+    if (!TRACE_ON)
+        return;
+
+    char esc[512];
+    json_escape(esc, sizeof(esc), detail ? detail : "");
+
+    char line[TRACE_LINE_SIZE];
+    int len = snprintf(line, sizeof(line),
+        "{\"name\":\"%s\",\"cat\":\"mq\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":%d,\"tid\":%d,"
+        "\"args\":{\"msg\":\"%s\"}},\n",
+        name, get_time_us(), getpid(), tid, esc);
+    trace_emit(line, len);
+}
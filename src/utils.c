@@ -1,5 +1,8 @@
 #include "utils.h"
 
+char *results_path = "results.txt";
+char *scores_path = "scores.txt";
+
 
 const char* get_status_message(int status) {
     switch (status) {
@@ -7,11 +10,25 @@ const char* get_status_message(int status) {
         case INCORRECT: return "incorrect";
         case SEGFAULT: return "crash";
         case STUCK_OR_INFINITE: return "stuck/inf";
+        case OUT_OF_MEMORY: return "mem-limit";
+        case OUTPUT_LIMIT_EXCEEDED: return "out-limit";
+        case PROCESS_LIMIT_EXCEEDED: return "pid-limit";
+        case SKIPPED: return "skipped";
         default: return "unknown";
     }
 }
 
 
+int answer_status(const char *output) {
+    char *end;
+    long answer = strtol(output, &end, 10);
+    end += strspn(end, " \t\n");
+    if (end == output || *end != '\0' || (answer != CORRECT && answer != INCORRECT))
+        return INCORRECT;
+    return answer;
+}
+
+
 char *get_exe_name(char *path) {
     return strrchr(path, '/') + 1;
 }
@@ -76,6 +93,67 @@ char **get_student_executables(char *solution_dir, int *num_executables) {
 }
 
 
+char *take_option(int *argc, char **argv, const char *name) {
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], name) != 0)
+            continue;
+
+        if (i + 1 >= *argc) {
+            fprintf(stderr, "Missing value for %s\n", name);
+            exit(1);
+        }
+
+        char *value = argv[i + 1];
+
+        // Shift the remaining arguments (including the NULL terminator) down
+        for (int j = i; j + 2 <= *argc; j++) {
+            argv[j] = argv[j + 2];
+        }
+        *argc -= 2;
+        return value;
+    }
+    return NULL;
+}
+
+
+int take_flag(int *argc, char **argv, const char *name) {
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], name) != 0)
+            continue;
+
+        for (int j = i; j + 1 <= *argc; j++) {
+            argv[j] = argv[j + 1];
+        }
+        *argc -= 1;
+        return 1;
+    }
+    return 0;
+}
+
+
+long long get_time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+long long parse_size(const char *option, const char *spec) {
+    char *end;
+    long long size = strtoll(spec, &end, 10);
+    switch (*end) {
+        case 'G': case 'g': size <<= 10;    // fall through
+        case 'M': case 'm': size <<= 10;    // fall through
+        case 'K': case 'k': size <<= 10; end++; break;
+    }
+    if (end == spec || *end != '\0' || size <= 0) {
+        fprintf(stderr, "Bad size '%s' for %s (expected e.g. 4096, 64K, 512M or 2G)\n", spec, option);
+        exit(1);
+    }
+    return size;
+}
+
+
 // TODO: Implement this function
 int get_batch_size() {
     FILE *fp = fopen("/proc/cpuinfo", "r");
@@ -98,24 +176,22 @@ int get_batch_size() {
 
 
 // TODO: Implement this function
-void create_input_files(char **argv_params, int num_parameters) {
-    for (int i = 0; i < num_parameters; ++i) {
-        char buff[BUFSIZ];
-        sprintf(buff, "input/%s.in", argv_params[i]);
-        int fd = open(buff, O_RDWR | O_CREAT, 0666);
-
-        if (fd == -1) {
-            perror("error creating input files");
-            exit(1);
-        }
+void create_input_file(char *label, char *param, int len) {
+    char buff[BUFSIZ];
+    sprintf(buff, "input/%s.in", label);
+    int fd = open(buff, O_RDWR | O_CREAT | O_TRUNC, 0666);
 
-        if (write(fd, argv_params[i], strlen(argv_params[i])) == -1) {
-            perror("error writing to input file");
-            close(fd);
-            exit(1);
+    if (fd == -1) {
+        perror("error creating input files");
+        exit(1);
     }
+
+    if (write(fd, param, len) == -1) {
+        perror("error writing to input file");
         close(fd);
+        exit(1);
     }
+    close(fd);
 }
 
 // TODO: Implement this function
@@ -131,9 +207,9 @@ void start_timer(int seconds, void (*timeout_handler)(int)) {
         exit(1);
     }
 
-    // set to send SIGALRM every TIMEOUT_SECS
+    // set to send SIGALRM after seconds
     struct itimerval timer;
-    timer.it_value.tv_sec = TIMEOUT_SECS;
+    timer.it_value.tv_sec = seconds;
     timer.it_value.tv_usec = 0;
     timer.it_interval.tv_sec = 0;
     timer.it_interval.tv_usec = 0;
@@ -157,14 +233,12 @@ void cancel_timer() {
 
 
 // TODO: Implement this function
-void remove_input_files(char **argv_params, int num_parameters) {
-    for (int i = 0; i < num_parameters; ++i) {
+void remove_input_file(char *label) {
     char buff[BUFSIZ];
-    sprintf(buff, "input/%s.in", argv_params[i]);
-        if (unlink(buff) == -1) {
-            perror("error removing input files");
-            exit(1);
-        }
+    sprintf(buff, "input/%s.in", label);
+    if (unlink(buff) == -1) {
+        perror("error removing input files");
+        exit(1);
     }
 }
 
@@ -174,7 +248,8 @@ void remove_output_files(autograder_results_t *results, int tested, int current_
     for (int i = 0; i < tested; i++) {
         char buff[BUFSIZ];
         sprintf(buff, "output/%s.%s", get_exe_name(results[i].exe_path), param);
-        if (unlink(buff) == -1) {
+        // Pairs that never ran (e.g. every worker that could test them died) have none
+        if (unlink(buff) == -1 && errno != ENOENT) {
             perror("error removing output files");
             exit(1);
         }
@@ -195,8 +270,72 @@ int get_longest_len_executable(autograder_results_t *results, int num_executable
 }
  
 
-void write_results_to_file(autograder_results_t *results, int num_executables, int total_params) {
-    FILE *file = fopen("results.txt", "w");
+// Write one row of results.txt (see write_results_to_file())
+static void write_results_row(FILE *file, autograder_results_t *result, int longest_len, param_source_t *params) {
+    char *exe_name = get_exe_name(result->exe_path);
+
+    char format[20];
+    sprintf(format, "%%-%ds:", longest_len);
+    fprintf(file, format, exe_name); // Write the program path
+
+    // Stream the parameters again for the column labels
+    param_source_rewind(params);
+    char *param;
+    int len;
+    for (long j = 0; (param = param_source_next(params, &len)) != NULL; j++) {
+        char label[PARAM_LABEL_MAX + 1];
+        param_label(label, param, len, j);
+        fprintf(file, "%5s (", label); // Write the pi value for the program
+        const char* message = get_status_message(result->status[j]);
+        fprintf(file, "%9s) ", message); // Write each status
+    }
+    fprintf(file, "\n");
+}
+
+
+// Number at the end of result's executable name, the sort key of the rows
+static int exe_number(autograder_results_t *result) {
+    char *number = strrchr(get_exe_name(result->exe_path), '_');
+    return number != NULL ? atoi(number + 1) : 0;
+}
+
+
+// By number, then by index
+static int compare_rows(const void *a, const void *b, void *results) {
+    int i = *(const int *) a, j = *(const int *) b;
+    int num_i = exe_number(&((autograder_results_t *) results)[i]);
+    int num_j = exe_number(&((autograder_results_t *) results)[j]);
+    if (num_i != num_j)
+        return num_i < num_j ? -1 : 1;
+    return i - j;
+}
+
+
+int *results_row_order(autograder_results_t *results, int num_executables) {
+    int *order = malloc(num_executables * sizeof(int));
+    for (int i = 0; i < num_executables; i++) {
+        order[i] = i;
+    }
+    qsort_r(order, num_executables, sizeof(int), compare_rows, results);
+    return order;
+}
+
+
+// Row of results[i] in results.txt (see results_row_order())
+static int row_of(autograder_results_t *results, int num_executables, int i) {
+    int row = 0;
+    for (int j = 0; j < num_executables; j++) {
+        row += j != i && compare_rows(&j, &i, results) < 0;
+    }
+    return row;
+}
+
+
+void write_results_to_file(autograder_results_t *results, int num_executables, param_source_t *params) {
+    // Written next to it and renamed into place, so readers never see a partial file
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", results_path);
+    FILE *file = fopen(tmp_path, "w");
     if (!file) {
         perror("Failed to open file");
         return;
@@ -212,71 +351,151 @@ void write_results_to_file(autograder_results_t *results, int num_executables, i
         }
     }
 
-    // Sort the results data structure by executable name (specifically number at the end)
-    for (int i = 0; i < num_executables; i++) {
-        for (int j = i + 1; j < num_executables; j++) {
-            char *exe_name_i = get_exe_name(results[i].exe_path);
-            int num_i = atoi(strrchr(exe_name_i, '_') + 1);
-            char *exe_name_j = get_exe_name(results[j].exe_path);
-            int num_j = atoi(strrchr(exe_name_j, '_') + 1);
-            if (num_i > num_j) {
-                autograder_results_t temp = results[i];
-                results[i] = results[j];
-                results[j] = temp;
-            }
-        }
-    }
+    // Sort by executable name (specifically number at the end), through indices so the
+    // caller's per-executable arrays still line up with results
+    int *order = results_row_order(results, num_executables);
 
     // Write results to file
-    for (int i = 0; i < num_executables; i++) {
-        char *exe_name = get_exe_name(results[i].exe_path);
-
-        char format[20];
-        sprintf(format, "%%-%ds:", longest_len);
-        fprintf(file, format, exe_name); // Write the program path
-        for (int j = 0; j < total_params; j++) {
-            fprintf(file, "%5d (", results[i].params_tested[j]); // Write the pi value for the program
-            const char* message = get_status_message(results[i].status[j]);
-            fprintf(file, "%9s) ", message); // Write each status
-        }
-        fprintf(file, "\n");
+    for (int k = 0; k < num_executables; k++) {
+        write_results_row(file, &results[order[k]], longest_len, params);
     }
+    free(order);
+
+    if (fclose(file) != 0 || rename(tmp_path, results_path) == -1)
+        perror(results_path);
+}
 
+
+// Overwrite line i of a file whose lines all have the same length as line, returns
+// -1 if the file doesn't have num_lines such lines
+static int pwrite_line(const char *path, int i, int num_lines, char *line, size_t len) {
+    int fd = open(path, O_WRONLY);
+    if (fd == -1)
+        return -1;
+
+    struct stat st;
+    int ok = fstat(fd, &st) == 0 && st.st_size == (off_t) (len * num_lines)
+             && pwrite(fd, line, len, (off_t) len * i) == (ssize_t) len;
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+
+int update_results_row(autograder_results_t *results, int num_executables, int i, param_source_t *params) {
+    char *row;
+    size_t len;
+    FILE *file = open_memstream(&row, &len);
+    write_results_row(file, &results[i], get_longest_len_executable(results, num_executables), params);
     fclose(file);
+
+    int ret = pwrite_line(results_path, row_of(results, num_executables, i), num_executables, row, len);
+    free(row);
+    return ret;
 }
 
 
-// TODO: Implement this function
-double get_score(char *results_file, char *executable_name) {
-    return 1.0;
+// Fraction of "correct" cells in a results.txt row (see write_results_to_file()).
+// Every cell counts: "unknown" ones (never tested, e.g. no mq worker was left) and
+// "skipped" ones (see policy.h) as not correct. Provisional scores over the tested
+// cells only are progress.c's business.
+static double row_score(const char *row) {
+    int correct = 0, cells = 0;
+    for (const char *c = strchr(row, ':'); c != NULL && (c = strchr(c, '(')) != NULL; c++) {
+        if (strlen(c) < 11 || c[10] != ')')
+            continue;
+
+        // Right-aligned in 9 characters
+        char cell[10];
+        memcpy(cell, c + 1, 9);
+        cell[9] = '\0';
+        char *status = cell + strspn(cell, " ");
+        cells++;
+        correct += strcmp(status, "correct") == 0;
+    }
+    return cells > 0 ? (double) correct / cells : 0.0;
 }
 
 
-void write_scores_to_file(autograder_results_t *results, int num_executables, char *results_file) {
-    for (int i = 0; i < num_executables; i++) {
-        double student_score = get_score(results_file, results[i].exe_path);
-        char *student_exe = get_exe_name(results[i].exe_path);
+double get_score(char *results_file, char *executable_name) {
+    FILE *fp = fopen(results_file, "r");
+    if (fp == NULL) {
+        perror(results_file);
+        return 0.0;
+    }
 
-        char score_file[] = "scores.txt";
+    // Every row is as long as the first one
+    char *row = NULL;
+    size_t cap = 0;
+    ssize_t row_len = getline(&row, &cap, fp);
+    fseek(fp, 0, SEEK_END);
+    long num_rows = row_len > 0 ? ftell(fp) / row_len : 0;
+
+    // Rows are sorted by the number after '_', so sol_<n> is normally row n - 1.
+    // Start there and go round the file until the name matches.
+    char *name = get_exe_name(executable_name);
+    size_t name_len = strlen(name);
+    char *number = strrchr(name, '_');
+    long guess = number != NULL ? atol(number + 1) - 1 : 0;
+    if (guess < 0 || guess >= num_rows)
+        guess = 0;
+
+    double score = 0.0;
+    char prefix[NAME_MAX + 2];
+    for (long k = 0; k < num_rows && name_len <= NAME_MAX; k++) {
+        long r = (guess + k) % num_rows;
+        fseek(fp, r * row_len, SEEK_SET);
+        if (fread(prefix, 1, name_len + 1, fp) != name_len + 1 || strncmp(prefix, name, name_len) != 0
+            || (prefix[name_len] != ' ' && prefix[name_len] != ':'))
+            continue;
+
+        fseek(fp, r * row_len, SEEK_SET);
+        if (getline(&row, &cap, fp) > 0)
+            score = row_score(row);
+        break;
+    }
 
-        FILE *score_fp;
-        if (i == 0)
-            score_fp = fopen(score_file, "w");
-        else
-            score_fp = fopen(score_file, "a");
+    free(row);
+    fclose(fp);
+    return score;
+}
 
-        if (!score_fp) {
-            perror("Failed to open score file");
-            exit(1);
-        }
 
-        int longest_len = get_longest_len_executable(results, num_executables);
+void write_scores_to_file(autograder_results_t *results, int num_executables, char *results_file) {
+    // Renamed into place once complete, like results.txt
+    char score_file[PATH_MAX];
+    snprintf(score_file, sizeof(score_file), "%s.tmp", scores_path);
+    FILE *score_fp = fopen(score_file, "w");
+    if (!score_fp) {
+        perror("Failed to open score file");
+        exit(1);
+    }
+
+    int longest_len = get_longest_len_executable(results, num_executables);
+
+    // In the order of results.txt
+    int *order = results_row_order(results, num_executables);
+    for (int k = 0; k < num_executables; k++) {
+        int i = order[k];
+        double student_score = get_score(results_file, results[i].exe_path);
+        char *student_exe = get_exe_name(results[i].exe_path);
 
         char format[20];
         sprintf(format, "%%-%ds: ", longest_len);
         fprintf(score_fp, format, student_exe);
         fprintf(score_fp, "%5.3f\n", student_score);
-
-        fclose(score_fp);
     }
+    free(order);
+
+    if (fclose(score_fp) != 0 || rename(score_file, scores_path) == -1)
+        perror(scores_path);
+}
+
+
+int update_score_line(autograder_results_t *results, int num_executables, int i, char *results_file) {
+    char format[20], line[NAME_MAX + 32];
+    sprintf(format, "%%-%ds: %%5.3f\n", get_longest_len_executable(results, num_executables));
+    int len = snprintf(line, sizeof(line), format, get_exe_name(results[i].exe_path),
+                       get_score(results_file, results[i].exe_path));
+
+    return pwrite_line(scores_path, row_of(results, num_executables, i), num_executables, line, len);
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "utils.h"
+#include "verify.h"
+
+long verify_rechecks;
+long verify_overturned;
+
+int verify_cores;                 // Processors (see get_batch_size())
+long long *verify_wait_us;        // Per slot, run-queue wait at the timeout (-1 if unknown)
+volatile int verify_runnable;     // Runnable tasks at the timeout, besides the grader (-1 if unknown)
+
+
+void verify_init(int slots) {
+    verify_cores = get_batch_size();
+    free(verify_wait_us);
+    verify_wait_us = malloc(slots * sizeof(long long));
+    for (int i = 0; i < slots; i++) {
+        verify_wait_us[i] = -1;
+    }
+    verify_runnable = -1;
+}
+
+
+// Read the small file at path into buf (NUL-terminated), returns its length or -1.
+// Only uses async-signal-safe calls.
+static int read_small_file(const char *path, char *buf, int size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    int len = read(fd, buf, size - 1);
+    close(fd);
+    if (len <= 0)
+        return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+
+// Parse the decimal number at *s and move past it and the separator after it
+static long long parse_number(char **s) {
+    long long n = 0;
+    for (; **s >= '0' && **s <= '9'; (*s)++) {
+        n = n * 10 + (**s - '0');
+    }
+    if (**s != '\0')
+        (*s)++;
+    return n;
+}
+
+
+void verify_snapshot_load() {
+    // "<load1> <load5> <load15> <runnable>/<total> <last pid>"
+    char buf[128];
+    verify_runnable = -1;
+    if (read_small_file("/proc/loadavg", buf, sizeof(buf)) == -1)
+        return;
+
+    char *s = buf;
+    for (int fields = 0; fields < 3 && *s != '\0'; s++) {
+        fields += *s == ' ';
+    }
+    verify_runnable = parse_number(&s) - 1;
+}
+
+
+void verify_snapshot(int slot, pid_t pid) {
+    if (verify_wait_us == NULL)
+        return;
+    verify_wait_us[slot] = -1;
+
+    // "<time on a cpu (ns)> <time waiting on a run queue (ns)> <timeslices>"
+    char path[64], buf[128];
+    int n = 0;
+    char digits[16];
+    do {
+        digits[n++] = '0' + pid % 10;
+        pid /= 10;
+    } while (pid > 0);
+    memcpy(path, "/proc/", 6);
+    for (int k = 0; k < n; k++) {
+        path[6 + k] = digits[n - 1 - k];
+    }
+    memcpy(path + 6 + n, "/schedstat", sizeof("/schedstat"));
+
+    if (read_small_file(path, buf, sizeof(buf)) == -1)
+        return;
+    char *s = buf;
+    parse_number(&s);
+    verify_wait_us[slot] = parse_number(&s) / 1000;
+}
+
+
+int verify_starved(int slot, long long wall_us, struct rusage *usage) {
+    if (wall_us <= 0)
+        return 0;
+
+    if (verify_wait_us != NULL && verify_wait_us[slot] != -1)
+        return verify_wait_us[slot] * VERIFY_STARVED_SHARE >= wall_us;
+
+    // No run-delay accounting -> CPU time against wall time and load
+    long long cpu_us = usage->ru_utime.tv_sec * 1000000LL + usage->ru_utime.tv_usec
+                       + usage->ru_stime.tv_sec * 1000000LL + usage->ru_stime.tv_usec;
+    if (verify_runnable <= verify_cores)
+        return 0;
+    return 2 * cpu_us * verify_runnable >= wall_us * verify_cores
+           && cpu_us * VERIFY_STARVED_SHARE < wall_us * (VERIFY_STARVED_SHARE - 1);
+}
+
+
+void verify_free() {
+    free(verify_wait_us);
+    verify_wait_us = NULL;
+}
@@ -0,0 +1,102 @@
+#include "utils.h"
+#include "watch.h"
+#include <sys/inotify.h>
+#include <poll.h>
+
+// Files with events that haven't settled yet
+typedef struct {
+    char *name;
+    long long last_event_us;
+} pending_t;
+
+pending_t *pending;
+int num_pending;
+
+
+int watch_open(const char *dir) {
+    int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd == -1 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB | IN_CREATE
+                                              | IN_DELETE | IN_MOVED_FROM) == -1) {
+        perror("Failed to watch solutions directory");
+        exit(1);
+    }
+    return fd;
+}
+
+
+static void touch(const char *name, long long now) {
+    for (int i = 0; i < num_pending; i++) {
+        if (strcmp(pending[i].name, name) == 0) {
+            pending[i].last_event_us = now;
+            return;
+        }
+    }
+
+    pending = realloc(pending, (num_pending + 1) * sizeof(pending_t));
+    pending[num_pending].name = strdup(name);
+    pending[num_pending].last_event_us = now;
+    num_pending++;
+}
+
+
+static void forget(const char *name) {
+    for (int i = 0; i < num_pending; i++) {
+        if (strcmp(pending[i].name, name) == 0) {
+            free(pending[i].name);
+            pending[i] = pending[--num_pending];
+            return;
+        }
+    }
+}
+
+
+// Read every queued inotify event
+static void read_events(int fd) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        long long now = get_time_us();
+        for (char *p = buffer; p < buffer + n; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+            struct inotify_event *event = (struct inotify_event *) p;
+            if (event->len == 0 || event->name[0] == '.')
+                continue;
+
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                forget(event->name);
+            else
+                touch(event->name, now);
+        }
+    }
+}
+
+
+char **watch_wait(int fd, int *count, volatile sig_atomic_t *stop) {
+    while (!*stop) {
+        // Hand out the files that have been quiet long enough
+        long long now = get_time_us();
+        long long next_settle = -1;
+        char **settled = NULL;
+        *count = 0;
+        for (int i = 0; i < num_pending; i++) {
+            long long settles_at = pending[i].last_event_us + WATCH_SETTLE_MS * 1000LL;
+            if (settles_at <= now) {
+                settled = realloc(settled, (*count + 1) * sizeof(char *));
+                settled[(*count)++] = pending[i].name;
+                pending[i--] = pending[--num_pending];
+            } else if (next_settle == -1 || settles_at < next_settle) {
+                next_settle = settles_at;
+            }
+        }
+        if (*count > 0)
+            return settled;
+
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int timeout_ms = next_settle == -1 ? -1 : (int) ((next_settle - now) / 1000) + 1;
+        if (poll(&pfd, 1, timeout_ms) == -1 && errno != EINTR) {
+            perror("poll");
+            exit(1);
+        }
+        read_events(fd);
+    }
+    return NULL;
+}
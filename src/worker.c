@@ -1,13 +1,19 @@
 #include "utils.h"
-
-// Run the (executable, parameter) pairs in batches of 8 to avoid timeouts due to 
-// having too many child processes running at once
-#define PAIRS_BATCH_SIZE 8
+#include "trace.h"
+#include "metrics.h"
+#include "compare.h"
+#include "contain.h"
+#include "stage.h"
+#include "profile.h"
+#include "pool.h"
 
 typedef struct {
     char *executable_path;
-    int parameter;
+    char *parameter;
+    int param_idx;                          // Index of the parameter in the autograder's source
+    char label[PARAM_LABEL_MAX + 1];        // Label of the parameter (see params.h)
     int status;
+    long long duration_us;                  // Run time, reported for scheduling (see history.h)
 } pairs_t;
 
 // Store the pairs tested by this worker and the results
@@ -20,25 +26,144 @@ int *child_status;     // Contains status of child processes (-1 for done, 1 for
 int curr_batch_size;   // At most PAIRS_BATCH_SIZE (executable, parameter) pairs will be run at once
 long worker_id;        // Used for sending/receiving messages from the message queue
 
+// Trace timestamps (see trace.h)
+long long *spawned_at;        // When each child of the batch was forked (always taken, for run times)
+volatile long long batch_killed_at;  // When the timeout handler fired for this batch (0 if it didn't)
+
+#define TIMING_ON (TRACE_ON || METRICS_ON)
+
+// Expected-output comparison (only with --expected, see compare.h)
+char *expected_dir;           // Directory of golden files (NULL when comparison is off)
+int compare_mode;
+double compare_tol;
+int out_fds[PAIRS_BATCH_SIZE];        // Read end of each child's stdout pipe
+compare_t cmps[PAIRS_BATCH_SIZE];     // Comparison state of each child's output
+
+// Golden digests of recently tested parameters. A batch may mix parameters, so
+// a few are kept and the least recently used one is replaced.
+#define GOLDEN_CACHE_SIZE (2 * PAIRS_BATCH_SIZE)
+struct {
+    golden_t *golden;
+    int param_idx;
+    int last_used;            // Batch number that last used this entry
+} golden_cache[GOLDEN_CACHE_SIZE];
+int batch_number;            // Current batch, numbered from 1
+
+
+// Digest of the golden output of a pair's parameter, loaded on first use
+golden_t *golden_for_pair(pairs_t *pair) {
+    // Unused entries have last_used 0 (batches are numbered from 1), so they go first
+    int victim = 0;
+    for (int i = 0; i < GOLDEN_CACHE_SIZE; i++) {
+        if (golden_cache[i].golden != NULL && golden_cache[i].param_idx == pair->param_idx) {
+            golden_cache[i].last_used = batch_number;
+            return golden_cache[i].golden;
+        }
+        if (golden_cache[i].last_used < golden_cache[victim].last_used)
+            victim = i;
+    }
+
+    // A batch uses at most PAIRS_BATCH_SIZE entries, so the victim is never in use
+    golden_free(golden_cache[victim].golden);
+    golden_cache[victim].golden = golden_load(expected_dir, pair->label, compare_mode, compare_tol);
+    golden_cache[victim].param_idx = pair->param_idx;
+    golden_cache[victim].last_used = batch_number;
+    return golden_cache[victim].golden;
+}
+
+
+// Send a message to the queue, exit on failure
+void send_msg(int msqid, long mtype, char *text) {
+    msgbuf_t msg;
+    msg.mtype = mtype;
+    strncpy(msg.mtext, text, MESSAGE_SIZE - 1);
+    msg.mtext[MESSAGE_SIZE - 1] = '\0';
+
+    while (msgsnd(msqid, &msg, MESSAGE_SIZE, 0) == -1) {
+        if (errno != EINTR) {
+            perror("Failed to send message in worker");
+            exit(1);
+        }
+    }
+
+    if (TRACE_ON)
+        trace_instant("msgsnd", worker_id, msg.mtext);
+}
+
+
+// Receive a message of type mtype from the queue (retrying if interrupted), exit on failure
+void receive_msg(int msqid, long mtype, msgbuf_t *msg) {
+    while (msgrcv(msqid, msg, MESSAGE_SIZE, mtype, 0) == -1) {
+        if (errno != EINTR) {
+            perror("Failed to receive message in worker");
+            exit(1);
+        }
+    }
+
+    if (TRACE_ON)
+        trace_instant("msgrcv", worker_id, msg->mtext);
+}
+
 
 // TODO: Timeout handler for alarm signal - should be the same as the one in autograder.c
 void timeout_handler(int signum) {
+    batch_killed_at = get_time_us();
 
+    // Kill everything still running
+    for (int i = 0; i < curr_batch_size; ++i) {
+        if (child_status != NULL && child_status[i] == 1)
+            contain_kill(pids[i], i);
+    }
 }
 
 
 // Execute the student's executable using exec()
-void execute_solution(char *executable_path, int param, int batch_idx) {
+void execute_solution(char *executable_path, char *param, char *label, int batch_idx) {
+    long long spawn_start = TIMING_ON ? get_time_us() : 0;
+    long long spawn_start_ns = PROFILE_ON ? profile_now() : 0;
+
+    // Staged copy of the executable (only with --stage, see stage.h)
+    int exe_fd = stage_fd(executable_path);
+
+    // Output is compared as it streams in -> stdout goes to a pipe
+    int outpipe[2];
+    if (expected_dir != NULL && pipe2(outpipe, O_CLOEXEC) == -1) {
+        perror("couldn't create output pipe");
+        exit(1);
+    }
+
+    // Tells when the program starts running (only with --profile, see profile.h)
+    int handshake[2];
+    profile_exec_pipe(handshake);
  
     pid_t pid = fork();
 
     // Child process
     if (pid == 0) {
+        contain_enter(batch_idx);
+
         char *executable_name = get_exe_name(executable_path);
 
         // TODO: Redirect STDOUT to output/<executable>.<input> file
+        char output_file[BUFSIZ];
+        sprintf(output_file, "output/%s.%s", executable_name, label);
+        int output_fd = expected_dir != NULL ? outpipe[1] : open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (output_fd == -1) {
+            perror("open");
+            exit(1);
+        }
+
+        if (dup2(output_fd, STDOUT_FILENO) == -1) {
+            perror("dup2");
+            close(output_fd);
+            exit(1);
+        }
+        close(output_fd);
 
         // TODO: Input to child program can be handled as in the EXEC case (see template.c)
+        profile_exec_begin(handshake);
+        stage_exec(exe_fd, (char *[]) { executable_name, param, NULL });
+        execlp(executable_path, executable_name, param, (char *) NULL);
         
         perror("Failed to execute program in worker");
         exit(1);
@@ -46,6 +171,22 @@ void execute_solution(char *executable_path, int param, int batch_idx) {
     // Parent process
     else if (pid > 0) {
         pids[batch_idx] = pid;
+        contain_adopt(pid);
+        profile_spawned(batch_idx, handshake, spawn_start_ns);
+
+        if (expected_dir != NULL) {
+            close(outpipe[1]);
+            out_fds[batch_idx] = outpipe[0];
+        }
+
+        spawned_at[batch_idx] = get_time_us();
+        if (TIMING_ON) {
+            trace_span("spawn", worker_id, spawn_start, spawned_at[batch_idx],
+                       get_exe_name(executable_path), label);
+            metrics_spawn_latency(spawned_at[batch_idx] - spawn_start);
+        }
+        if (METRICS_ON)
+            METRICS_ADD(in_flight, 1);
     }
     // Fork failed
     else {
@@ -63,19 +204,46 @@ void monitor_and_evaluate_solutions(int finished) {
         child_status[j] = 1;
     }
 
-    // MAIN EVALUATION LOOP: Wait until each process has finished or timed out
-    for (int j = 0; j < curr_batch_size; j++) {
-        char *current_exe_path = pairs[finished + j].executable_path;
-        int current_param = pairs[finished + j].parameter;
+    // Compare the outputs as they stream in (and stop children that already failed)
+    if (expected_dir != NULL) {
+        compare_drain(curr_batch_size, out_fds, cmps, NULL, pids, &batch_killed_at);
+    }
 
+    // MAIN EVALUATION LOOP: Wait until each process has finished or timed out.
+    // Children are reaped in the order they finish, so their run times are accurate.
+    for (int reaped = 0; reaped < curr_batch_size; reaped++) {
         int status;
-        pid_t pid = waitpid(pids[j], &status, 0);
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, 0, &usage);
 
         // TODO: What if waitpid is interrupted by a signal?
+        while (pid == -1 && errno == EINTR) {
+            pid = wait4(-1, &status, 0, &usage);
+        }
+
+        if (pid == -1) {
+            perror("Failed to wait for child process in worker");
+            exit(1);
+        }
+
+        // Find the batch slot of the reaped child
+        int j = 0;
+        while (j < curr_batch_size && pids[j] != pid) {
+            j++;
+        }
+        if (j == curr_batch_size || child_status[j] == -1) {
+            // Orphan re-parented to us (see contain.h) -> doesn't count towards the batch
+            reaped--;
+            continue;
+        }
+
+        char *current_exe_path = pairs[finished + j].executable_path;
+        char *current_label = pairs[finished + j].label;
 
+        long long harvest_start = get_time_us();
+        long long evaluate_start = profile_reaped(j);
+        pairs[finished + j].duration_us = harvest_start - spawned_at[j];
 
-        int exit_status = WEXITSTATUS(status);
-        int exited = WIFEXITED(status);
         int signaled = WIFSIGNALED(status);
 
         // TODO: Check if the process finished normally, segfaulted, or timed out and update the 
@@ -83,67 +251,186 @@ void monitor_and_evaluate_solutions(int finished) {
         //       the status field of the pairs_t struct (e.g. CORRECT, INCORRECT, SEGFAULT, etc.)
         //       This should be the same as the evaluation in autograder.c, just updating `pairs` 
         //       instead of `results`.
+        if (expected_dir != NULL && cmps[j].over_limit) {
+            pairs[finished + j].status = OUTPUT_LIMIT_EXCEEDED;
+        } else if (expected_dir != NULL && cmps[j].killed) {
+            // Killed because of the mismatch - that's not a timeout
+            pairs[finished + j].status = INCORRECT;
+        } else if (signaled) {
+            int signal_number = WTERMSIG(status);
+
+            if (signal_number == SIGKILL) {
+                // Child process was killed by the alarm
+                pairs[finished + j].status = STUCK_OR_INFINITE;
+            } else {
+                // Child process triggered a segmentation fault, or crashed some other way
+                pairs[finished + j].status = SEGFAULT;
+            }
+        } else if (expected_dir != NULL) {
+            // Exited normally -> the verdict of the output comparison
+            pairs[finished + j].status = cmps[j].finished && !cmps[j].mismatch ? CORRECT : INCORRECT;
+        } else {
+            // Exited normally -> the answer is in output/<executable>.<input>
+            char output_file[BUFSIZ];
+            sprintf(output_file, "output/%s.%s", get_exe_name(current_exe_path), current_label);
+            int output_fd = open(output_file, O_RDONLY);
+            if (output_fd == -1) {
+                perror("open");
+                exit(1);
+            }
+
+            char buffer[BUFSIZ];
+            ssize_t num_bytes = read(output_fd, buffer, sizeof(buffer) - 1);
+            if (num_bytes == -1) {
+                perror("read");
+                exit(1);
+            }
+
+            buffer[num_bytes] = '\0';
+            pairs[finished + j].status = answer_status(buffer);
+            close(output_fd);
+        }
+
+        // A child that ran into one of its limits gets that outcome, whatever it printed
+        int limit_status = contain_limit_status(j, status, &usage);
+        if (limit_status != 0) {
+            pairs[finished + j].status = limit_status;
+        }
+        long long release_start = profile_since(PROFILE_EVALUATE, evaluate_start);
 
+        // Kill whatever the child left running (only a leak if it wasn't killed already)
+        int tree_killed = (signaled && WTERMSIG(status) == SIGKILL && batch_killed_at != 0)
+                          || (expected_dir != NULL && cmps[j].killed);
+        contain_release(pid, j, tree_killed, get_exe_name(current_exe_path), current_label);
+        profile_since(PROFILE_RELEASE, release_start);
 
         // Mark the process as finished
         child_status[j] = -1;
+
+        // Pairs done/outcomes are counted by mq_autograder when it receives the results
+        if (METRICS_ON) {
+            METRICS_ADD(in_flight, -1);
+            if (signaled && WTERMSIG(status) == SIGKILL && batch_killed_at != 0
+                && (expected_dir == NULL || !cmps[j].killed))
+                METRICS_ADD(timeout_kills, 1);
+        }
+
+        if (TRACE_ON) {
+            char *param_str = current_label;
+            char *exe_name = get_exe_name(current_exe_path);
+            trace_span("run", worker_id, spawned_at[j], harvest_start, exe_name, param_str);
+            if (signaled && WTERMSIG(status) == SIGKILL && batch_killed_at != 0) {
+                trace_span("timeout-kill", worker_id, batch_killed_at, harvest_start, exe_name, param_str);
+            }
+            trace_span("harvest", worker_id, harvest_start, get_time_us(), exe_name, param_str);
+        }
     }
 
     free(child_status);
+    child_status = NULL;
 }
 
 
 // Send results for the current batch back to the autograder
 void send_results(int msqid, long mtype, int finished) {
-    // Format of message should be ("%s %d %d", executable_path, parameter, status)
-
+    // Format of message should be ("%s %d %d %lld", executable_path, parameter index, status, run time in us),
+    // with --profile followed by " %lld", the time it was sent (see profile.h)
+    for (int j = 0; j < curr_batch_size; j++) {
+        char text[MESSAGE_SIZE];
+        int len = snprintf(text, MESSAGE_SIZE, "%s %d %d %lld", pairs[finished + j].executable_path,
+                           pairs[finished + j].param_idx, pairs[finished + j].status, pairs[finished + j].duration_us);
+
+        long long report_start = PROFILE_ON ? profile_now() : 0;
+        if (PROFILE_ON && len < MESSAGE_SIZE)
+            snprintf(text + len, MESSAGE_SIZE - len, " %lld", report_start);
+        send_msg(msqid, mtype, text);
+        profile_since(PROFILE_REPORT, report_start);
+    }
 }
 
 
 // Send DONE message to autograder to indicate that the worker has finished testing
 void send_done_msg(int msqid, long mtype) {
-
+    send_msg(msqid, mtype, "DONE");
 }
 
 
-int main(int argc, char **argv) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <msqid> <worker_id>\n", argv[0]);
-        return 1;
-    }
-
-    int msqid = atoi(argv[1]);
-    worker_id = atoi(argv[2]);
-
+// Receive the number of pairs and then the pairs into pairs, returns how many there
+// are, or -1 if a persistent worker is told to exit (see pool.h)
+int receive_pairs(int msqid) {
     // TODO: Receive initial message from autograder specifying the number of (executable, parameter) 
-    // pairs that the worker will test (should just be an integer in the message body). (mtype = worker_id)
+    // pairs that the worker will test (should just be an integer in the message body). (mtype = PAIRS_MTYPE(worker_id))
+    msgbuf_t msg;
+    receive_msg(msqid, PAIRS_MTYPE(worker_id), &msg);
+    if (strcmp(msg.mtext, POOL_EXIT_MSG) == 0)
+        return -1;
 
     // TODO: Parse message and set up pairs_t array
-    int pairs_to_test;
+    int pairs_to_test = atoi(msg.mtext);
+    pairs = malloc(pairs_to_test * sizeof(pairs_t));
 
     // TODO: Receive (executable, parameter) pairs from autograder and store them in pairs_t array.
-    //       Messages will have the format ("%s %d", executable_path, parameter). (mtype = worker_id)
+    //       Messages will have the format ("%s %d %s", executable_path, parameter index, parameter)
+    //       where the parameter is the rest of the message (it may contain spaces). (mtype = PAIRS_MTYPE(worker_id))
+    for (int i = 0; i < pairs_to_test; i++) {
+        receive_msg(msqid, PAIRS_MTYPE(worker_id), &msg);
+
+        char exe_path[MESSAGE_SIZE];
+        int offset;
+        if (sscanf(msg.mtext, "%s %d %n", exe_path, &pairs[i].param_idx, &offset) != 2) {
+            fprintf(stderr, "Malformed pair message: %s\n", msg.mtext);
+            exit(1);
+        }
+        pairs[i].executable_path = strdup(exe_path);
+        pairs[i].parameter = strdup(msg.mtext + offset);
+        param_label(pairs[i].label, pairs[i].parameter, strlen(pairs[i].parameter), pairs[i].param_idx);
+        pairs[i].status = 0;
+    }
 
-    // TODO: Send ACK message to mq_autograder after all pairs received (mtype = BROADCAST_MTYPE)
+    return pairs_to_test;
+}
 
-    // TODO: Wait for SYNACK from autograder to start testing (mtype = BROADCAST_MTYPE).
-    //       Be careful to account for the possibility of receiving ACK messages just sent.
+
+// Start reading every executable of the pairs ahead, once each (see stage.h)
+void stage_pairs(int pairs_to_test) {
+    char **exe_paths = malloc(pairs_to_test * sizeof(char *));
+    int num_exe_paths = 0;
+    for (int i = 0; i < pairs_to_test; i++) {
+        if (num_exe_paths == 0 || strcmp(exe_paths[num_exe_paths - 1], pairs[i].executable_path) != 0)
+            exe_paths[num_exe_paths++] = pairs[i].executable_path;
+    }
+    stage_init(exe_paths, num_exe_paths);
+    free(exe_paths);
+}
 
 
-    // Run the pairs in batches of 8 and send results back to autograder
+// Run the pairs in batches of 8 and send results back to autograder
+void run_pairs(int msqid, int pairs_to_test) {
     for (int i = 0; i < pairs_to_test; i+= PAIRS_BATCH_SIZE) {
         int remaining = pairs_to_test - i;
         curr_batch_size = remaining < PAIRS_BATCH_SIZE ? remaining : PAIRS_BATCH_SIZE;
         pids = malloc(curr_batch_size * sizeof(pid_t));
+        spawned_at = malloc(curr_batch_size * sizeof(long long));
+        batch_killed_at = 0;
+        batch_number++;
+        profile_batch(pids, curr_batch_size);
 
         for (int j = 0; j < curr_batch_size; j++) {
+            if (expected_dir != NULL)
+                compare_init(&cmps[j], golden_for_pair(&pairs[i + j]));
+
             // TODO: Execute the student executable
-            execute_solution(pairs[i + j].executable_path, pairs[i + j].parameter, j);
+            execute_solution(pairs[i + j].executable_path, pairs[i + j].parameter, pairs[i + j].label, j);
         }
 
         // TODO: Setup timer to determine if child process is stuck
             start_timer(TIMEOUT_SECS, timeout_handler);  // Implement this function (src/utils.c)
 
+        // Stage the next batch's executables while this one runs (see stage.h)
+        for (int k = i + curr_batch_size; k < pairs_to_test && k < i + curr_batch_size + PAIRS_BATCH_SIZE; k++) {
+            stage_fd(pairs[k].executable_path);
+        }
+
         // TODO: Wait for the batch to finish and check results
         monitor_and_evaluate_solutions(i);
 
@@ -155,17 +442,105 @@ int main(int argc, char **argv) {
         // TODO: Send batch results (intermediate results) back to autograder
         send_results(msqid, worker_id, i);
 
+        profile_batch(NULL, 0);
         free(pids);
+        free(spawned_at);
     }
+}
 
-    // TODO: Send DONE message to autograder to indicate that the worker has finished testing
-    send_done_msg(msqid, worker_id);
 
-    // Free the pairs_t array
+// Free the pairs and the golden digests of their parameters (parameter indices only
+// mean something within one job)
+void free_pairs(int pairs_to_test) {
     for (int i = 0; i < pairs_to_test; i++) {
         free(pairs[i].executable_path);
+        free(pairs[i].parameter);
     }
     free(pairs);
+    pairs = NULL;
+
+    for (int i = 0; i < GOLDEN_CACHE_SIZE; i++) {
+        golden_free(golden_cache[i].golden);
+        golden_cache[i].golden = NULL;
+        golden_cache[i].last_used = 0;
+    }
+}
+
+
+int main(int argc, char **argv) {
+    char *trace_path = take_option(&argc, argv, "--trace");
+    char *metrics_shm = take_option(&argc, argv, "--metrics-shm");
+    char *profile_shm = take_option(&argc, argv, "--profile-shm");
+    expected_dir = take_option(&argc, argv, "--expected");
+    char *compare_spec = take_option(&argc, argv, "--compare");
+    int staging = take_flag(&argc, argv, "--stage");
+    int persistent = take_flag(&argc, argv, "--persistent");
+    contain_limits_from_args(&argc, argv);
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <msqid> <worker_id> [--trace <file>] [--metrics-shm <shmid>] [--profile-shm <shmid>] [--expected <dir> [--compare <mode>]] [--stage] [--persistent] [--mem-limit <size>] [--output-limit <size>] [--proc-limit <n>]\n", argv[0]);
+        return 1;
+    }
+
+    compare_parse_mode(compare_spec != NULL ? compare_spec : "exact", &compare_mode, &compare_tol);
+
+    if (metrics_shm != NULL) {
+        metrics_attach(atoi(metrics_shm));
+    }
+    if (profile_shm != NULL) {
+        profile_attach(atoi(profile_shm));
+    }
+
+    int msqid = atoi(argv[1]);
+    worker_id = atoi(argv[2]);
+
+    contain_init(PAIRS_BATCH_SIZE);
+
+    if (trace_path != NULL) {
+        // Append to the file the coordinator created
+        trace_open(trace_path, 0);
+        char name[32];
+        sprintf(name, "worker %ld", worker_id);
+        trace_process_name(name);
+        trace_thread_name(worker_id, name);
+    }
+
+    // A persistent worker runs one job after another until it is told to exit (see pool.h)
+    if (persistent) {
+        int pairs_to_test;
+        while ((pairs_to_test = receive_pairs(msqid)) != -1) {
+            if (staging)
+                stage_pairs(pairs_to_test);
+            run_pairs(msqid, pairs_to_test);
+            send_done_msg(msqid, worker_id);
+            free_pairs(pairs_to_test);
+        }
+    } else {
+        int pairs_to_test = receive_pairs(msqid);
+        if (staging)
+            stage_pairs(pairs_to_test);
+
+        // TODO: Send ACK message to mq_autograder after all pairs received (mtype = worker_id,
+        //       see PAIRS_MTYPE in utils.h)
+        send_msg(msqid, worker_id, "ACK");
+
+        // TODO: Wait for SYNACK from autograder to start testing (mtype = BROADCAST_MTYPE).
+        //       Only SYNACKs are sent with BROADCAST_MTYPE, so any one of them will do.
+        msgbuf_t msg;
+        receive_msg(msqid, BROADCAST_MTYPE, &msg);
+
+        run_pairs(msqid, pairs_to_test);
+
+        // TODO: Send DONE message to autograder to indicate that the worker has finished testing
+        send_done_msg(msqid, worker_id);
+
+        free_pairs(pairs_to_test);
+    }
+
+    stage_free();
 
-    free(pids);
+    trace_close();
+    metrics_stop();
+    profile_stop(NULL);
+    contain_finish();
 }
\ No newline at end of file
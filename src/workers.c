@@ -0,0 +1,174 @@
+#include "utils.h"
+#include "contain.h"
+#include "workers.h"
+
+
+pid_t worker_spawn(int msqid, int worker_id, const worker_options_t *options) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("Failed to fork worker");
+        exit(1);
+    }
+    if (pid > 0)
+        return pid;
+
+    // Ctrl-C on the pool's terminal stops the pool, which then stops the workers. They
+    // stay in the pool's process group, which contain_bury() leaves alone.
+    if (options->persistent)
+        signal(SIGINT, SIG_IGN);
+
+    char msqid_str[16], worker_id_str[16], shmid_str[16], profile_shmid_str[16];
+    sprintf(msqid_str, "%d", msqid);
+    sprintf(worker_id_str, "%d", worker_id);
+
+    char *worker_argv[24];
+    int n = 0;
+    worker_argv[n++] = "worker";
+    worker_argv[n++] = msqid_str;
+    worker_argv[n++] = worker_id_str;
+    if (options->persistent) {
+        worker_argv[n++] = "--persistent";
+    }
+    if (options->trace_path != NULL) {
+        worker_argv[n++] = "--trace";
+        worker_argv[n++] = options->trace_path;
+    }
+    if (options->metrics_shmid != -1) {
+        sprintf(shmid_str, "%d", options->metrics_shmid);
+        worker_argv[n++] = "--metrics-shm";
+        worker_argv[n++] = shmid_str;
+    }
+    if (options->profile_shmid != -1) {
+        sprintf(profile_shmid_str, "%d", options->profile_shmid);
+        worker_argv[n++] = "--profile-shm";
+        worker_argv[n++] = profile_shmid_str;
+    }
+    if (options->expected_dir != NULL) {
+        worker_argv[n++] = "--expected";
+        worker_argv[n++] = options->expected_dir;
+    }
+    if (options->compare_spec != NULL) {
+        worker_argv[n++] = "--compare";
+        worker_argv[n++] = options->compare_spec;
+    }
+    if (options->staging) {
+        worker_argv[n++] = "--stage";
+    }
+    char limit_strs[3][32];
+    if (contain_limits.memory > 0) {
+        sprintf(limit_strs[0], "%lld", contain_limits.memory);
+        worker_argv[n++] = "--mem-limit";
+        worker_argv[n++] = limit_strs[0];
+    }
+    if (contain_limits.output > 0) {
+        sprintf(limit_strs[1], "%lld", contain_limits.output);
+        worker_argv[n++] = "--output-limit";
+        worker_argv[n++] = limit_strs[1];
+    }
+    if (contain_limits.procs > 0) {
+        sprintf(limit_strs[2], "%d", contain_limits.procs);
+        worker_argv[n++] = "--proc-limit";
+        worker_argv[n++] = limit_strs[2];
+    }
+    worker_argv[n] = NULL;
+
+    execv("./worker", worker_argv);
+
+    perror("Failed to spawn worker");
+    exit(1);
+}
+
+
+int worker_kill_if_hung(pid_t pid, int worker_id, long long heard_at) {
+    if (get_time_us() - heard_at <= WORKER_HEARTBEAT_SECS * 1000000LL)
+        return 0;
+
+    fprintf(stderr, "Worker %d (pid %d) sent nothing for %d s, killing it\n",
+            worker_id, pid, WORKER_HEARTBEAT_SECS);
+    kill(pid, SIGKILL);
+    return 1;
+}
+
+
+void pairs_init(pairs_t *pairs, int num_pairs) {
+    pairs->num_pairs = num_pairs;
+    pairs->owner = malloc((num_pairs > 0 ? num_pairs : 1) * sizeof(int));
+    for (int p = 0; p < num_pairs; p++) {
+        pairs->owner[p] = -1;
+    }
+    pairs->done = calloc(num_pairs > 0 ? num_pairs : 1, 1);
+    pairs->num_done = 0;
+    pairs->orphaned = malloc((num_pairs > 0 ? num_pairs : 1) * sizeof(int));
+    pairs->num_orphaned = 0;
+    pairs->respawns = 0;
+}
+
+
+void pairs_assign(pairs_t *pairs, int p, int w) {
+    pairs->owner[p] = w;
+    if (w == -1)
+        pairs->orphaned[pairs->num_orphaned++] = p;
+}
+
+
+int pairs_finish(pairs_t *pairs, int p) {
+    if (pairs->done[p])
+        return 0;
+    pairs->done[p] = 1;
+    pairs->num_done++;
+    return 1;
+}
+
+
+int pairs_orphan(pairs_t *pairs, int w) {
+    int unfinished = 0;
+    for (int p = 0; p < pairs->num_pairs; p++) {
+        if (pairs->owner[p] == w && !pairs->done[p]) {
+            pairs_assign(pairs, p, -1);
+            unfinished++;
+        }
+    }
+    return unfinished;
+}
+
+
+int pairs_orphan_slot(pairs_t *pairs, int num_workers, int (*state)(int w)) {
+    if (pairs->num_orphaned == 0)
+        return -1;
+
+    int dead = -1;
+    for (int w = 0; w < num_workers; w++) {
+        int s = state(w);
+        if (s == SLOT_IDLE)
+            return w;
+        if (s == SLOT_DEAD)
+            dead = w;
+    }
+    if (dead == -1 || pairs->respawns == WORKER_RESPAWN_LIMIT)
+        return -1;
+    pairs->respawns++;
+    return dead;
+}
+
+
+static int compare_pairs(const void *a, const void *b) {
+    return *(const int *) a - *(const int *) b;
+}
+
+
+int *pairs_take_orphans(pairs_t *pairs, int *n) {
+    *n = pairs->num_orphaned;
+    int *taken = malloc((*n > 0 ? *n : 1) * sizeof(int));
+    memcpy(taken, pairs->orphaned, *n * sizeof(int));
+    qsort(taken, *n, sizeof(int), compare_pairs);
+    pairs->num_orphaned = 0;
+    return taken;
+}
+
+
+void pairs_free(pairs_t *pairs) {
+    free(pairs->owner);
+    free(pairs->done);
+    free(pairs->orphaned);
+    memset(pairs, 0, sizeof(pairs_t));
+}